@@ -0,0 +1,145 @@
+/* arena.c */
+
+/*
+
+Copyright (C) 2015 Scott A. Czepiel
+
+    This file is part of mlelr.
+
+    mlelr is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    mlelr is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with mlelr.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dataset.h"
+#include "interface.h"
+#include "arena.h"
+
+/* every allocation starts on this boundary, enough for any type */
+#define ARENA_ALIGN 16
+
+/* the first chunk holds this many bytes, and each after it twice the last, up to the most */
+static const size_t MIN_CHUNK_BYTES = 1 << 12;
+static const size_t MAX_CHUNK_BYTES = 1 << 24;
+
+struct arena_chunk {
+    arena_chunk *next;      /* the chunk allocated before this one, or NULL */
+    size_t       size;      /* bytes this chunk can hand out */
+    size_t       used;      /* bytes handed out so far */
+};
+
+/* allocations start this far into a chunk, past its header */
+#define CHUNK_HEADER ((sizeof(arena_chunk) + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN)
+
+
+/* public function definitions */
+
+void init_arena (arena *a) {
+
+    a->head = NULL;
+
+}
+
+
+void *arena_alloc (arena *a, size_t bytes) {
+
+    /* return bytes of memory that last until the arena is reset or freed */
+
+    arena_chunk *c;
+    size_t size;
+    void *p;
+
+    bytes = (bytes + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN;
+
+    if (a->head == NULL || a->head->size - a->head->used < bytes) {
+        size = (a->head == NULL) ? MIN_CHUNK_BYTES : 2 * a->head->size;
+        size = (size > MAX_CHUNK_BYTES) ? MAX_CHUNK_BYTES : size;
+        size = (size < bytes) ? bytes : size;
+        c = (arena_chunk *) emalloc(CHUNK_HEADER + size);
+        c->next = a->head;
+        c->size = size;
+        c->used = 0;
+        a->head = c;
+    }
+
+    p = (char *) a->head + CHUNK_HEADER + a->head->used;
+    a->head->used += bytes;
+
+    return p;
+}
+
+
+void *arena_grow (arena *a, void *old, size_t oldbytes, size_t newbytes) {
+
+    /* return a copy of old with room for newbytes; old itself is not reclaimed until the arena is */
+
+    void *p = arena_alloc(a, newbytes);
+
+    if (old != NULL) {
+        memcpy(p, old, (oldbytes < newbytes) ? oldbytes : newbytes);
+    }
+
+    return p;
+}
+
+
+char *arena_strdup (arena *a, const char *s) {
+
+    size_t len = strlen(s) + 1;
+
+    return (char *) memcpy(arena_alloc(a, len), s, len);
+}
+
+
+void reset_arena (arena *a) {
+
+    /***
+        Release every allocation.  The newest chunk is kept to reuse if it
+        is of the first size, but a larger one, grown by one big command,
+        is freed, so that its memory is not held for the rest of the
+        session.
+    ***/
+
+    arena_chunk *c, *next;
+
+    if (a->head == NULL) {
+        return;
+    }
+    for (c = a->head->next; c != NULL; c = next) {
+        next = c->next;
+        free(c);
+    }
+    a->head->next = NULL;
+    a->head->used = 0;
+    if (a->head->size != MIN_CHUNK_BYTES) {
+        free(a->head);
+        a->head = NULL;
+    }
+
+}
+
+
+void free_arena (arena *a) {
+
+    arena_chunk *c, *next;
+
+    for (c = a->head; c != NULL; c = next) {
+        next = c->next;
+        free(c);
+    }
+    a->head = NULL;
+
+}
@@ -0,0 +1,56 @@
+/* arena.h */
+
+/*
+
+Copyright (C) 2015 Scott A. Czepiel
+
+    This file is part of mlelr.
+
+    mlelr is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    mlelr is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with mlelr.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef ARENA_H__
+#define ARENA_H__
+
+#include <stddef.h>
+
+/***
+    arena
+
+    A bump-pointer allocator.  Memory is handed out from a list of large
+    chunks and is never freed piece by piece: everything allocated from an
+    arena is released together, by one free_arena, in a handful of calls
+    to free however many allocations were made.  reset_arena keeps the
+    newest chunk for reuse if it is of the first, smallest size, so an
+    arena emptied and refilled by small commands stops allocating, while
+    the larger chunks of a big command are given back once it is done.
+***/
+typedef struct arena_chunk arena_chunk;
+
+typedef struct {
+    arena_chunk *head;      /* newest chunk, which allocations come from, or NULL */
+} arena;
+
+
+/* forward declarations for publically available functions defined in arena.c */
+
+extern void init_arena (arena *a);
+extern void *arena_alloc (arena *a, size_t bytes);
+extern void *arena_grow (arena *a, void *old, size_t oldbytes, size_t newbytes);
+extern char *arena_strdup (arena *a, const char *s);
+extern void reset_arena (arena *a);
+extern void free_arena (arena *a);
+
+#endif
@@ -7,6 +7,10 @@
     Changes to the original:
     Replaced "static char fieldsep[]" with a 'delim' arg to csvgetline
     Added "compress" argument to csvgetline
+    Added csvsplitbuf and csvspancopy for parsing records in place
+    Moved the static state into a csvparser object, so that each thread
+    can own its own parser; the original calls use a default parser
+    Replaced the strcspn and byte-by-byte scans with block bitmasks
 
     This csv library is from the aforementioned text and continues to be the
     reigning champion of csv libraries ever implemented.  It is simple, clean,
@@ -27,26 +31,74 @@
     consecutive delimiters as one character.  This is most useful in parsing
     commands as it allows us to ignore multiple simultaneous spaces.
 
+    Much later, a third addition: csvsplitbuf splits a record that already
+    sits in memory (for example, a memory-mapped file) without copying it.
+    Fields are returned as spans into the caller's buffer rather than as
+    NUL-terminated strings, and csvspancopy turns a span into a string with
+    the same unquoting rules that advquoted applies.
+
+    The original kept its buffers in static variables, which is perfectly
+    fine until two threads want to parse at once.  That state now lives in
+    a csvparser, and the _r variants take one explicitly.  csvgetline,
+    csvfield and csvnfield carry on exactly as before on a parser of their
+    own, so the command interpreter is none the wiser.
+
+    Finally, the scanning itself.  split used strcspn(p, &delim) to find a
+    separator, which is wrong: &delim is not a terminated string, so strcspn
+    goes on to treat whatever follows delim in memory as more separators.
+    Both split and csvsplitbuf now find separators with nextsep, which
+    compares 64 bytes at a time against the delimiter, \n and \r (with
+    SSE2 or AVX2 where the compiler offers them) and keeps the resulting
+    bitmask, so that one block of compares serves every field that ends
+    within it.  Quotes are not part of the mask: a quote is only special
+    as the first char of a field, which we can check directly, and the
+    closing quote is then found with memchr.
+
 ***/
 
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <assert.h>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include "csv.h"
 
 enum { NOMEM = -2 };          /* out of memory signal */
 
-static char *line    = NULL;  /* input chars */
-static char *sline   = NULL;  /* line copy used by split */
-static int  maxline  = 0;     /* size of line[] and sline[] */
-static char **field  = NULL;  /* field pointers */
-static int  maxfield = 0;     /* size of field[] */
-static int  nfield   = 0;     /* number of fields in field[] */
+struct csvparser {
+	char *line;     /* input chars */
+	char *sline;    /* line copy used by split */
+	int  maxline;   /* size of line[] and sline[] */
+	char **field;   /* field pointers */
+	int  maxfield;  /* size of field[] */
+	int  nfield;    /* number of fields in field[] */
+	csvspan *span;  /* field spans from csvsplitbuf */
+	int  maxspan;   /* size of span[] */
+	int  nspan;     /* number of spans in span[] */
+};
+
+static csvparser defparser;   /* used by csvgetline, csvfield, csvnfield */
 
-static char *advquoted(char *p, char delim);
-static int split(char delim, int compress);
+enum { BLOCK = 64 };          /* bytes covered by one separator mask */
+
+/* sepscan: separator bits of the block at base, bit i for base[i] */
+typedef struct {
+	const char *base;
+	uint64_t mask;
+} sepscan;
+
+static char *advquoted(char *p, char *end, char delim);
+static int split(csvparser *cp, int len, char delim, int compress);
+static uint64_t sepmask(const char *p, char delim);
+static const char *nextsep(sepscan *sc, const char *p, const char *end,
+	char delim);
 
 /* endofline: check for and consume \r, \n, \r\n, or EOF */
 static int endofline(FILE *fin, int c)
@@ -63,83 +115,102 @@ static int endofline(FILE *fin, int c)
 }
 
 /* reset: set variables back to starting values */
-static void reset(void)
+static void reset(csvparser *cp)
+{
+	free(cp->line);	/* free(NULL) permitted by ANSI C */
+	free(cp->sline);
+	free(cp->field);
+	cp->line = NULL;
+	cp->sline = NULL;
+	cp->field = NULL;
+	cp->maxline = cp->maxfield = cp->nfield = 0;
+}
+
+/* csvnew:  allocate an empty parser */
+csvparser *csvnew(void)
 {
-	free(line);	/* free(NULL) permitted by ANSI C */
-	free(sline);
-	free(field);
-	line = NULL;
-	sline = NULL;
-	field = NULL;
-	maxline = maxfield = nfield = 0;
+	return (csvparser *) calloc(1, sizeof(csvparser));
 }
 
-/* csvgetline:  get one line, grow as needed */
+/* csvfree:  release a parser and all of its buffers */
+void csvfree(csvparser *cp)
+{
+	if (cp == NULL)
+		return;
+	reset(cp);
+	free(cp->span);
+	free(cp);
+}
+
+/* csvgetline_r:  get one line, grow as needed */
 /* sample input: "LU",86.25,"11/4/1998","2:19PM",+4.0625 */
-char *csvgetline(FILE *fin, char delim, int compress)
+char *csvgetline_r(csvparser *cp, FILE *fin, char delim, int compress)
 {
 	int i, c;
 	char *newl, *news;
 
-	if (line == NULL) {			/* allocate on first call */
-		maxline = maxfield = 1;
-		line = (char *) malloc(maxline);
-		sline = (char *) malloc(maxline);
-		field = (char **) malloc(maxfield*sizeof(field[0]));
-		if (line == NULL || sline == NULL || field == NULL) {
-			reset();
+	if (cp->line == NULL) {			/* allocate on first call */
+		cp->maxline = cp->maxfield = 1;
+		cp->line = (char *) malloc(cp->maxline);
+		cp->sline = (char *) malloc(cp->maxline);
+		cp->field = (char **) malloc(cp->maxfield*sizeof(cp->field[0]));
+		if (cp->line == NULL || cp->sline == NULL || cp->field == NULL) {
+			reset(cp);
 			return NULL;		/* out of memory */
 		}
 	}
 	for (i=0; (c=getc(fin))!=EOF && !endofline(fin,c); i++) {
-		if (i >= maxline-1) {	/* grow line */
-			maxline *= 2;		/* double current size */
-			newl = (char *) realloc(line, maxline);
+		if (i >= cp->maxline-1) {	/* grow line */
+			cp->maxline *= 2;		/* double current size */
+			newl = (char *) realloc(cp->line, cp->maxline);
 			if (newl == NULL) {
-				reset();
+				reset(cp);
 				return NULL;
 			}
-			line = newl;
-			news = (char *) realloc(sline, maxline);
+			cp->line = newl;
+			news = (char *) realloc(cp->sline, cp->maxline);
 			if (news == NULL) {
-				reset();
+				reset(cp);
 				return NULL;
 			}
-			sline = news;
+			cp->sline = news;
 
 
 		}
-		line[i] = c;
+		cp->line[i] = c;
 	}
-	line[i] = '\0';
-	if (split(delim, compress) == NOMEM) {
-		reset();
+	cp->line[i] = '\0';
+	if (split(cp, i, delim, compress) == NOMEM) {
+		reset(cp);
 		return NULL;			/* out of memory */
 	}
-	return (c == EOF && i == 0) ? NULL : line;
+	return (c == EOF && i == 0) ? NULL : cp->line;
 }
 
 /* split: split line into fields */
-static int split(char delim, int compress)
+static int split(csvparser *cp, int len, char delim, int compress)
 {
-	char *p, **newf;
+	char *p, *end, **newf;
 	char *sepp; /* pointer to temporary separator character */
 	int sepc;   /* temporary separator character */
+	sepscan sc;
 
-	nfield = 0;
-	if (line[0] == '\0')
+	cp->nfield = 0;
+	if (cp->line[0] == '\0')
 		return 0;
-	strcpy(sline, line);
-	p = sline;
+	memcpy(cp->sline, cp->line, len+1);
+	p = cp->sline;
+	end = p + len;
+	sc.base = NULL;
 
 	do {
-		if (nfield >= maxfield) {
-			maxfield *= 2;			/* double current size */
-			newf = (char **) realloc(field,
-						maxfield * sizeof(field[0]));
+		if (cp->nfield >= cp->maxfield) {
+			cp->maxfield *= 2;			/* double current size */
+			newf = (char **) realloc(cp->field,
+						cp->maxfield * sizeof(cp->field[0]));
 			if (newf == NULL)
 				return NOMEM;
-			field = newf;
+			cp->field = newf;
 		}
 		/* compress subsequent delimiter characters */
 		if (compress) {
@@ -148,48 +219,242 @@ static int split(char delim, int compress)
 		    }
 		}
 		if (*p == '"')
-			sepp = advquoted(++p, delim);	/* skip initial quote */
+			sepp = advquoted(++p, end, delim);	/* skip initial quote */
 		else
-			sepp = p + strcspn(p, &delim);
+			sepp = (char *) nextsep(&sc, p, end, delim);
 		sepc = sepp[0];
 		sepp[0] = '\0';				/* terminate field */
-		field[nfield++] = p;
+		cp->field[cp->nfield++] = p;
 		p = sepp + 1;
 	} while (sepc == (int) delim);
 
-	return nfield;
+	return cp->nfield;
 }
 
 /* advquoted: quoted field; return pointer to next separator */
-static char *advquoted(char *p, char delim)
+static char *advquoted(char *p, char *end, char delim)
 {
-	int i, j;
+	char *r, *w, *q;
 
-	for (i = j = 0; p[j] != '\0'; i++, j++) {
-		if (p[j] == '"' && p[++j] != '"') {
-			/* copy up to next separator or \0 */
-			int k = strcspn(p+j, &delim);
-			memmove(p+i, p+j, k);
-			i += k;
-			j += k;
+	for (r = w = p; ; ) {
+		if ((q = memchr(r, '"', end - r)) == NULL) {
+			/* no closing quote: the field runs to the end */
+			memmove(w, r, end - r);
+			w += end - r;
+			r = end;
 			break;
 		}
-		p[i] = p[j];
+		memmove(w, r, q - r);
+		w += q - r;
+		if (q+1 < end && q[1] == '"') {	/* doubled quote */
+			*w++ = '"';
+			r = q + 2;
+			continue;
+		}
+		/* copy up to next separator or \0 */
+		r = q + 1;
+		if ((q = memchr(r, delim, end - r)) == NULL)
+			q = end;
+		memmove(w, r, q - r);
+		w += q - r;
+		r = q;
+		break;
 	}
-	p[i] = '\0';
-	return p + j;
+	*w = '\0';
+	return r;
 }
 
-/* csvfield:  return pointer to n-th field */
-char *csvfield(int n)
+/* sepmask: bitmask of delim, \n and \r in the BLOCK bytes at p */
+static uint64_t sepmask(const char *p, char delim)
+{
+	uint64_t m = 0;
+	int i;
+
+#if defined(__AVX2__)
+	__m256i d = _mm256_set1_epi8(delim);
+	__m256i n = _mm256_set1_epi8('\n');
+	__m256i r = _mm256_set1_epi8('\r');
+	__m256i v, e;
+
+	for (i = 0; i < BLOCK; i += 32) {
+		v = _mm256_loadu_si256((const __m256i *) (p + i));
+		e = _mm256_or_si256(_mm256_cmpeq_epi8(v, d),
+			_mm256_or_si256(_mm256_cmpeq_epi8(v, n), _mm256_cmpeq_epi8(v, r)));
+		m |= (uint64_t) (uint32_t) _mm256_movemask_epi8(e) << i;
+	}
+#elif defined(__SSE2__)
+	__m128i d = _mm_set1_epi8(delim);
+	__m128i n = _mm_set1_epi8('\n');
+	__m128i r = _mm_set1_epi8('\r');
+	__m128i v, e;
+
+	for (i = 0; i < BLOCK; i += 16) {
+		v = _mm_loadu_si128((const __m128i *) (p + i));
+		e = _mm_or_si128(_mm_cmpeq_epi8(v, d),
+			_mm_or_si128(_mm_cmpeq_epi8(v, n), _mm_cmpeq_epi8(v, r)));
+		m |= (uint64_t) (uint16_t) _mm_movemask_epi8(e) << i;
+	}
+#else
+	for (i = 0; i < BLOCK; i++)
+		if (p[i] == delim || p[i] == '\n' || p[i] == '\r')
+			m |= (uint64_t) 1 << i;
+#endif
+	return m;
+}
+
+/* nextsep: first delim, \n or \r at or after p, or end if none */
+static const char *nextsep(sepscan *sc, const char *p, const char *end,
+	char delim)
 {
-	if (n < 0 || n >= nfield)
+	uint64_t m;
+
+	for (;;) {
+		/* use what is left of the current block's mask */
+		if (sc->base != NULL && p >= sc->base && p < sc->base + BLOCK) {
+			m = sc->mask & (~(uint64_t) 0 << (p - sc->base));
+			if (m != 0)
+				return sc->base + __builtin_ctzll(m);
+			p = sc->base + BLOCK;
+		}
+		/* too close to the end for a full block */
+		if (end - p < BLOCK) {
+			sc->base = NULL;
+			while (p < end && *p != delim && *p != '\n' && *p != '\r')
+				p++;
+			return p;
+		}
+		sc->base = p;
+		sc->mask = sepmask(p, delim);
+	}
+}
+
+/* csvfield_r:  return pointer to n-th field */
+char *csvfield_r(csvparser *cp, int n)
+{
+	if (n < 0 || n >= cp->nfield)
 		return NULL;
-	return field[n];
+	return cp->field[n];
+}
+
+/* csvnfield_r:  return number of fields */
+int csvnfield_r(csvparser *cp)
+{
+	return cp->nfield;
+}
+
+/* csvgetline:  csvgetline_r on the default parser */
+char *csvgetline(FILE *fin, char delim, int compress)
+{
+	return csvgetline_r(&defparser, fin, delim, compress);
+}
+
+/* csvfield:  return pointer to n-th field of the default parser */
+char *csvfield(int n)
+{
+	return csvfield_r(&defparser, n);
 }
 
-/* csvnfield:  return number of fields */
+/* csvnfield:  return number of fields of the default parser */
 int csvnfield(void)
 {
-	return nfield;
+	return csvnfield_r(&defparser);
+}
+
+/* csvsplitbuf:  split the record starting at p into spans, in place */
+/* returns start of the next record, or NULL if p is at end */
+const char *csvsplitbuf(csvparser *cp, const char *p, const char *end, char delim)
+{
+	const char *eol, *q, *sepp;
+	csvspan *newf;
+	sepscan sc;
+	int n;
+
+	if (p >= end)
+		return NULL;
+
+	n = 0;
+	sc.base = NULL;
+	if (*p == '\n' || *p == '\r')
+		eol = p;			/* empty record */
+	else for (;;) {
+		if (n >= cp->maxspan) {
+			cp->maxspan = (cp->maxspan > 0) ? 2 * cp->maxspan : 1;
+			newf = (csvspan *) realloc(cp->span,
+					cp->maxspan * sizeof(csvspan));
+			if (newf == NULL)
+				return NULL;
+			cp->span = newf;
+		}
+		cp->span[n].quoted = (*p == '"');
+		q = p;
+		if (*p == '"') {
+			/* skip to the closing quote, as advquoted does */
+			for (q = ++p; q < end && *q != '\n' && *q != '\r'; q++) {
+				if (*q == '"') {
+					if (q+1 < end && q[1] == '"')
+						q++;
+					else {
+						q++;
+						break;
+					}
+				}
+			}
+		}
+		sepp = nextsep(&sc, q, end, delim);
+		cp->span[n].p = p;
+		cp->span[n].len = sepp - p;
+		n++;
+		if (sepp < end && *sepp == delim)
+			p = sepp + 1;
+		else {
+			eol = sepp;
+			break;
+		}
+	}
+	cp->nspan = n;
+
+	/* consume \r, \n, or \r\n */
+	if (eol < end && *eol++ == '\r' && eol < end && *eol == '\n')
+		eol++;
+	return eol;
+}
+
+/* csvspan_r:  return pointer to n-th span from csvsplitbuf */
+const csvspan *csvspan_r(csvparser *cp, int n)
+{
+	if (n < 0 || n >= cp->nspan)
+		return NULL;
+	return &cp->span[n];
+}
+
+/* csvnspan_r:  return number of spans from csvsplitbuf */
+int csvnspan_r(csvparser *cp)
+{
+	return cp->nspan;
+}
+
+/* csvspancopy:  copy span f into buf as a string, removing quotes */
+/* buf must have room for f->len+1 chars; returns length of string */
+int csvspancopy(const csvspan *f, char *buf)
+{
+	int i, j;
+
+	if (!f->quoted) {
+		memcpy(buf, f->p, f->len);
+		buf[f->len] = '\0';
+		return f->len;
+	}
+	for (i = j = 0; j < f->len; i++, j++) {
+		if (f->p[j] == '"' && (++j >= f->len || f->p[j] != '"')) {
+			/* copy the rest up to the separator */
+			if (j < f->len) {
+				memcpy(buf+i, f->p+j, f->len-j);
+				i += f->len - j;
+			}
+			break;
+		}
+		buf[i] = f->p[j];
+	}
+	buf[i] = '\0';
+	return i;
 }
@@ -7,8 +7,30 @@
 
 /* csv.h: interface for csv library */
 
+/* csvspan: one field of a record parsed in place by csvsplitbuf */
+typedef struct {
+	const char *p;	/* first char of field, after any opening quote */
+	int len;	/* number of chars up to the separator */
+	int quoted;	/* 1 if field began with a quote */
+} csvspan;
+
+/* csvparser: buffers for one stream of input, one per thread */
+typedef struct csvparser csvparser;
+
 extern char *csvgetline(FILE *f, char delim, int compress); /* read next input line */
 extern char *csvfield(int n);	  /* return field n */
 extern int csvnfield(void);		  /* return number of fields */
 
+extern csvparser *csvnew(void);	  /* allocate a parser */
+extern void csvfree(csvparser *cp);	  /* release a parser */
+extern char *csvgetline_r(csvparser *cp, FILE *f, char delim, int compress);
+extern char *csvfield_r(csvparser *cp, int n);
+extern int csvnfield_r(csvparser *cp);
+
+extern const char *csvsplitbuf(csvparser *cp, const char *p, const char *end,
+	char delim);			  /* split record in buffer */
+extern const csvspan *csvspan_r(csvparser *cp, int n); /* return span n */
+extern int csvnspan_r(csvparser *cp);	  /* return number of spans */
+extern int csvspancopy(const csvspan *f, char *buf); /* span to string */
+
 #endif
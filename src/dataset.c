@@ -25,10 +25,13 @@ Copyright (C) 2015 Scott A. Czepiel
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
-#include <errno.h>
+#include <float.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include "dataset.h"
 #include "interface.h"
-#include "csv.h"
+#include "radixsort.h"
 
 /***
     SYSMIS
@@ -42,10 +45,33 @@ const double SYSMIS = 0xffefffffffffffff;
 
 struct dataspace dataspace;
 
+/* blocks of rows double in size from MIN_BLOCK_ROWS until they reach MAX_BLOCK_BYTES */
+static const int MIN_BLOCK_ROWS = 16;
+static const size_t MAX_BLOCK_BYTES = 1 << 22;
+
+/* bytes of rows allocated in memory by all datasets, held to the memlimit option */
+static size_t rows_in_memory = 0;
+
+/* number of observations copied at a time when pivoting to rows */
+static const int BATCH_ROWS = 4096;
+
+/* names and sizes of the storage types, in the order of enum coltype */
+static char *coltype_names[] = {"double", "float32", "int32", "int16", "int8", "code8", "code16"};
+static const size_t coltype_sizes[] = {sizeof(double), sizeof(float), sizeof(int32_t),
+    sizeof(int16_t), sizeof(int8_t), sizeof(uint8_t), sizeof(uint16_t)};
+
 
 /* static function declarations */
-static int compare_obs (const void *v1, const void *v2);
-static int string_to_double(char *str, double* d);
+static void add_block (dataset *ds, int rows);
+static void grow_obs (dataset *ds, int size);
+static double *spill_block (size_t bytes);
+static void free_blocks (dataset *ds);
+static void release_dataset (dataset *ds);
+static int fits_coltype (double v, int type);
+static int infer_coltype (dataset *ds, int var);
+static int build_levels (dataset *ds, int var, int max, double **levels);
+static int find_level (const double *levels, int nlevels, double v);
+static int compare_doubles (const void *v1, const void *v2);
 
 
 /* public function definitions */
@@ -62,97 +88,6 @@ void init_dataspace (void) {
 }
 
 
-int import_dataset (char *handle, char *filename, char delim) {
-
-    /* import a delimited text file as a new dataset */
-
-    int i, j;
-    FILE *ifp;
-    char **varnames;
-    int nvars = 0;
-    char *line;
-    double *obs;
-    dataset *ds;
-
-    printlog(INFO, "%s%s\n", "Importing dataset from file: ", filename);
-
-    /* try to open file */
-    if ((ifp = fopen(filename, "r")) == NULL) {
-        printlog(INFO, "%s%s\n", "Error:  Could not open file: ", filename);
-        return -1;
-    }
-
-    /***
-        read variable names from first row
-    ***/
-
-    if (csvgetline(ifp, delim, 0) == NULL) {
-        printlog(INFO, "%s%s\n", "Error:  File is empty, ", filename);
-        return -1;
-    }
-
-    /* set number of variables to number of fields parsed */
-    if ((nvars = csvnfield()) < 1) {
-        printlog(INFO, "%s\n", "Error:  No variable names found.  Check that delimiter string is correct.");
-        return -1;
-    }
-
-    printlog(INFO, "%s%d\n", "Number of variables found: ", nvars);
-
-    /* allocate space to store variable names */
-    varnames = (char **) emalloc(nvars * sizeof(char *));
-
-    /* read in varnames */
-    printlog(INFO, "%s", "Variable names: ");
-    for (i = 0; i < nvars; i++) {
-        varnames[i] = estrdup(csvfield(i));
-        printlog(INFO, "%s ", varnames[i]);
-    }
-    printlog(INFO, "\n");
-
-    /***
-        add a new dataset to the dataspace
-    ***/
-
-    ds = add_dataset(handle, nvars, varnames, 1);
-    obs = (double *) emalloc(nvars * sizeof(double));
-
-    /* read the data until end of file */
-    for (i = 0; (line = csvgetline(ifp, delim, 0)) != NULL; i++) {
-
-        /* for each line, fail if we do not have the expected number of fields */
-        if (csvnfield() != nvars) {
-            printlog(INFO, "%s%d%s%d%s%d%s\n%s\n", "Error:  Invalid field count at row: ", i + 2,
-                ".  Fields expected: ", nvars, ".  Fields found: ", csvnfield(), ".  Failed record: ", line);
-            return -1;
-        }
-
-        /* parse the data in each field and store in obs */
-        for (j = 0; j < nvars; j++) {
-
-            if (string_to_double(csvfield(j), &obs[j]) < 0) {
-
-                /* set to sysmis if could not read as double,
-                   this is a debatable solution, but really
-                   only affects edge cases unlikely to come up
-                   in practice */
-                obs[j] = SYSMIS;
-            }
-        }
-
-        /* add this observation to the dataset */
-        add_observation(ds, obs);
-
-    }
-
-    printlog(INFO, "%s%d\n", "Number of observations read: ", ds->n);
-    fclose(ifp);
-    printlog(INFO, "%s\n", "Import complete.");
-
-    return 0;
-}
-
-
 void print_dataset(dataset *ds, int n, int header) {
 
     int i, j;
@@ -162,7 +97,7 @@ void print_dataset(dataset *ds, int n, int header) {
         return;
     }
 
-    if (n == 0) {
+    if (n == 0 || n > ds->n) {
         n = ds->n;
     }
 
@@ -176,9 +111,18 @@ void print_dataset(dataset *ds, int n, int header) {
         printout("%16s", ds->varnames[i]);
     }
     printout("\n");
+
+    /* the storage type of each column, under its name */
+    if (header && ds->cols != NULL) {
+        for (i = 0; i < ds->nvars; i++) {
+            printout("%16s", coltype_name(ds->cols[i].type));
+        }
+        printout("\n");
+    }
+
     for (i = 0; i < n; i++) {
         for (j = 0; j < ds->nvars; j++) {
-            printout("%16.2f", ds->obs[i][j]);
+            printout("%16.2f", get_value(ds, i, j));
         }
         printout("\n");
     }
@@ -214,12 +158,17 @@ dataset *add_dataset (char *handle, int nvars, char **varnames, int is_public) {
 
     ds->handle = estrdup(handle);
     ds->n = 0;
-    ds->size = 1;
+    ds->size = 0;
     ds->nvars = nvars;
     ds->varnames = varnames;
     ds->weight = -1;
-    ds->values = (double *) emalloc(ds->size * ds->nvars * sizeof(double));
-    ds->obs = (double **) emalloc(ds->size * ds->nvars * sizeof(double));
+    ds->cols = NULL;
+    ds->blocks = NULL;
+    ds->nblocks = 0;
+    ds->obs = NULL;
+    ds->obssize = 0;
+    ds->map = NULL;
+    ds->maplen = 0;
 
     if (is_public) {
         printlog(INFO, "%s%s\n", "New dataset created with handle: ", ds->handle);
@@ -234,58 +183,470 @@ dataset *add_dataset (char *handle, int nvars, char **varnames, int is_public) {
 
 void add_observation (dataset *ds, double *obs) {
 
-    int i;
+    /* append the observation to the dataset */
+    memcpy(new_observation(ds), obs, ds->nvars * sizeof(double));
+
+}
+
+
+void add_observations (dataset *ds, double *obs, int count) {
+
+    /* append count observations stored contiguously in obs */
+    int i, run;
+
+    if (count < 1) {
+        return;
+    }
+
+    reserve_observations(ds, count);
+
+    /* copy as many rows at a time as lie together in one block */
+    for (i = 0; i < count; i += run) {
+        for (run = 1; i + run < count
+            && ds->obs[ds->n + i + run] == ds->obs[ds->n + i] + (size_t) run * ds->nvars; run++);
+        memcpy(ds->obs[ds->n + i], &obs[(size_t) i * ds->nvars], (size_t) run * ds->nvars * sizeof(double));
+    }
+    ds->n += count;
+
+}
+
+
+double *new_observation (dataset *ds) {
+
+    /* append an observation for the caller to fill in, and return its row */
 
-    /* grow the array of values if needed */
-    if (1 + ds->n >= ds->size) {
-        ds->size *= 2;
-        printlog(VERBOSE, "Reallocating the array of values in dataset '%s' with space for %d observations\n", ds->handle, ds->size);
-        ds->values = (double *) erealloc(ds->values, ds->size * ds->nvars * sizeof(double));
+    int rows;
 
-        /* set dataset pointers */
-        ds->obs = (double **) erealloc(ds->obs, ds->size * ds->nvars * sizeof(double *));
-        for (i = 0; i < ds->size; i++) {
-            ds->obs[i] = &ds->values[i * ds->nvars];
+    /***
+        Rather than reallocate and copy every row whenever the dataset is
+        full, add a block of rows.  Each block is as large as all those
+        before it, so there are few of them, but no larger than about
+        MAX_BLOCK_BYTES, so the unused tail of the last one stays small.
+    ***/
+    if (ds->n >= ds->size) {
+        rows = (ds->size > MIN_BLOCK_ROWS) ? ds->size : MIN_BLOCK_ROWS;
+        if ((size_t) rows * ds->nvars * sizeof(double) > MAX_BLOCK_BYTES) {
+            rows = MAX_BLOCK_BYTES / (ds->nvars * sizeof(double));
+            rows = (rows > 0) ? rows : 1;
         }
+        add_block(ds, rows);
     }
 
-    printlog(VERBOSE, "Adding obs to dataset '%s': %d\n", ds->handle, ds->n);
+    return ds->obs[ds->n++];
+}
 
-    /* append the observations to the dataset */
-    for (i = 0; i < ds->nvars; i++) {
-        ds->values[i + (ds->n * ds->nvars)] = obs[i];
+
+void reserve_observations (dataset *ds, int count) {
+
+    /* make room for count more observations in at most one new block */
+
+    if (ds->size - ds->n < count) {
+        add_block(ds, count - (ds->size - ds->n));
     }
 
-    ds->n++;
+}
+
+
+void move_observations (dataset *ds, dataset *src) {
+
+    /***
+        Append the observations of src, which has the same variables as ds,
+        by taking over its blocks rather than copying them.  src is left
+        empty.  The rows of src are listed after those of ds, and the
+        unused rows of both follow.
+    ***/
+
+    int spare = ds->size - ds->n;
+
+    if (src->n == 0) {
+        return;
+    }
+
+    grow_obs(ds, ds->size + src->size);
+    memmove(&ds->obs[ds->n + src->n], &ds->obs[ds->n], spare * sizeof(double *));
+    memcpy(&ds->obs[ds->n], src->obs, src->n * sizeof(double *));
+    memcpy(&ds->obs[ds->n + src->n + spare], &src->obs[src->n], (src->size - src->n) * sizeof(double *));
+
+    ds->blocks = (dsblock *) erealloc(ds->blocks, (ds->nblocks + src->nblocks) * sizeof(dsblock));
+    memcpy(&ds->blocks[ds->nblocks], src->blocks, src->nblocks * sizeof(dsblock));
+    ds->nblocks += src->nblocks;
+    ds->n += src->n;
+    ds->size += src->size;
+
+    free(src->blocks);
+    free(src->obs);
+    src->blocks = NULL;
+    src->obs = NULL;
+    src->n = src->size = src->nblocks = src->obssize = 0;
+
+}
+
+
+void attach_observations (dataset *ds, double *rows, int count, void *map, size_t maplen) {
+
+    /***
+        Give an empty dataset count rows stored contiguously at rows, inside
+        a file mapping that the dataset then owns.  The rows are used where
+        they lie; only the pointers to them are allocated.
+    ***/
+
+    int i;
+
+    grow_obs(ds, count);
+    for (i = 0; i < count; i++) {
+        ds->obs[i] = &rows[(size_t) i * ds->nvars];
+    }
+    ds->n = ds->size = count;
+    ds->map = map;
+    ds->maplen = maplen;
+
+}
+
+
+void free_dataset (dataset *ds) {
+
+    /* release a dataset created with is_public = 0; its varnames belong to the caller */
+
+    release_dataset(ds);
+    free(ds);
 
 }
 
 
+int drop_dataset (char *handle) {
+
+    /***
+        Release the public dataset with this handle, and its varnames,
+        which a public dataset owns, and close up the dataspace after it.
+        Any pointer into the dataspace is stale afterwards.
+    ***/
+
+    dataset *ds;
+    int i, j;
+
+    if ((ds = find_dataset(handle)) == NULL) {
+        return -1;
+    }
+
+    for (j = 0; j < ds->nvars; j++) {
+        free(ds->varnames[j]);
+    }
+    free(ds->varnames);
+    release_dataset(ds);
+
+    i = ds - dataspace.datasets;
+    memmove(ds, ds + 1, (dataspace.n - i - 1) * sizeof(dataset));
+    dataspace.n--;
+
+    printlog(INFO, "%s%s\n", "Dropped dataset: ", handle);
+
+    return 0;
+}
+
+
 void sort_dataset(dataset *ds, int n_cols) {
 
-    compare_obs(NULL, &n_cols);
-    qsort(ds->values, ds->n, ds->nvars * sizeof(double), compare_obs);
+    /* the rows stay where they are, and only the pointers to them are sorted */
+    radix_sort_rows(ds->obs, ds->n, n_cols, atoi(get_option("threads")));
 
     return;
 }
 
 
-int compare_obs (const void *v1, const void *v2) {
+int compact_dataset (dataset *ds, int *types) {
 
-    static int sort_columns = 1;
-    const double *a = (const double *) v1;
-    const double *b = (const double *) v2;
-    int i;
+    /***
+        Move the rows of ds into one typed column per variable, and free
+        the rows.  types[j] is the type to store variable j as, or -1 to
+        use the smallest type that holds every value exactly.  If types is
+        NULL, every type is chosen this way.  Coded types are never chosen
+        this way, only declared.  A declared type that cannot hold every
+        value is an error, and leaves ds as it was.
+    ***/
+
+    dscolumn *cols;
+    size_t before, after;
+    int i, j;
 
-    /* trickery */
-    if (v1 == NULL) {
-        sort_columns = *(int *) v2;
+    if (ds->cols != NULL) {
         return 0;
     }
 
-    for (i = 0; i < sort_columns && a[i] == b[i]; i++);
+    /* settle every type before anything is moved */
+    cols = (dscolumn *) emalloc(ds->nvars * sizeof(dscolumn));
+    for (j = 0; j < ds->nvars; j++) {
+        cols[j].levels = NULL;
+        cols[j].nlevels = 0;
+        cols[j].mapped = 0;
+    }
+    for (j = 0; j < ds->nvars; j++) {
+        if (types == NULL || types[j] < 0) {
+            cols[j].type = infer_coltype(ds, j);
+        }
+        else if (types[j] == COL_CODE8 || types[j] == COL_CODE16) {
+            cols[j].type = types[j];
+            cols[j].nlevels = build_levels(ds, j, (types[j] == COL_CODE8) ? 256 : MAX_LEVELS, &cols[j].levels);
+            if (cols[j].nlevels < 0) {
+                printlog(INFO, "Error:  '%s' has too many distinct values for %s, or NaN or -0, dataset not compacted\n",
+                    ds->varnames[j], coltype_name(types[j]));
+                for (i = 0; i < j; i++) {
+                    free(cols[i].levels);
+                }
+                free(cols);
+                return -1;
+            }
+        }
+        else {
+            cols[j].type = types[j];
+            for (i = 0; i < ds->n && fits_coltype(ds->obs[i][j], types[j]); i++);
+            if (i < ds->n) {
+                printlog(INFO, "Error:  Value at row %d of '%s' does not fit in %s, dataset not compacted\n", i + 1,
+                    ds->varnames[j], coltype_name(types[j]));
+                for (i = 0; i < j; i++) {
+                    free(cols[i].levels);
+                }
+                free(cols);
+                return -1;
+            }
+        }
+    }
 
-    return (a[i] > b[i]) - (a[i] < b[i]);
+    /* gather each column from the rows */
+    before = (size_t) ds->n * ds->nvars * sizeof(double);
+    after = 0;
+    for (j = 0; j < ds->nvars; j++) {
+        cols[j].data = emalloc((ds->n > 0 ? ds->n : 1) * coltype_sizes[cols[j].type]);
+        after += (size_t) ds->n * coltype_sizes[cols[j].type] + cols[j].nlevels * sizeof(double);
+        for (i = 0; i < ds->n; i++) {
+            switch (cols[j].type) {
+                case COL_INT8:
+                    ((int8_t *) cols[j].data)[i] = (ds->obs[i][j] == SYSMIS) ? INT8_MIN : (int8_t) ds->obs[i][j];
+                    break;
+                case COL_INT16:
+                    ((int16_t *) cols[j].data)[i] = (ds->obs[i][j] == SYSMIS) ? INT16_MIN : (int16_t) ds->obs[i][j];
+                    break;
+                case COL_INT32:
+                    ((int32_t *) cols[j].data)[i] = (ds->obs[i][j] == SYSMIS) ? INT32_MIN : (int32_t) ds->obs[i][j];
+                    break;
+                case COL_FLOAT:
+                    ((float *) cols[j].data)[i] = (float) ds->obs[i][j];
+                    break;
+                case COL_CODE8:
+                    ((uint8_t *) cols[j].data)[i] = find_level(cols[j].levels, cols[j].nlevels, ds->obs[i][j]);
+                    break;
+                case COL_CODE16:
+                    ((uint16_t *) cols[j].data)[i] = find_level(cols[j].levels, cols[j].nlevels, ds->obs[i][j]);
+                    break;
+                default:
+                    ((double *) cols[j].data)[i] = ds->obs[i][j];
+                    break;
+            }
+        }
+    }
+
+    set_columns(ds, cols, ds->n);
+
+    printlog(INFO, "Compacted dataset '%s' from %lu to %lu bytes\n", ds->handle,
+        (unsigned long) before, (unsigned long) after);
+
+    return 0;
+}
+
+
+int pivot_dataset (dataset *ds, int columns) {
+
+    /***
+        Store ds as one column of doubles per variable if columns is set,
+        else as rows.  A scan of a few variables then reads only their
+        columns rather than every row.  Typed columns are widened back to
+        doubles when pivoted to rows.
+    ***/
+
+    dataset src;
+    dscolumn *cols;
+    double *buf;
+    int i, j, k, rows;
+
+    if ((ds->cols != NULL) == (columns != 0)) {
+        return 0;
+    }
+
+    if (columns) {
+        cols = (dscolumn *) emalloc(ds->nvars * sizeof(dscolumn));
+        for (j = 0; j < ds->nvars; j++) {
+            cols[j].type = COL_DOUBLE;
+            cols[j].data = emalloc((ds->n > 0 ? ds->n : 1) * sizeof(double));
+            cols[j].levels = NULL;
+            cols[j].nlevels = 0;
+            cols[j].mapped = 0;
+            for (i = 0; i < ds->n; i++) {
+                ((double *) cols[j].data)[i] = ds->obs[i][j];
+            }
+        }
+        set_columns(ds, cols, ds->n);
+    }
+    else {
+        /* read from a copy of ds that still holds the columns while ds is given rows */
+        src = *ds;
+        ds->cols = NULL;
+        ds->n = ds->size = 0;
+        reserve_observations(ds, src.n);
+        buf = (double *) emalloc(BATCH_ROWS * sizeof(double));
+        for (j = 0; j < ds->nvars; j++) {
+            for (i = 0; i < src.n; i += rows) {
+                rows = (src.n - i < BATCH_ROWS) ? src.n - i : BATCH_ROWS;
+                get_values(&src, j, i, rows, buf);
+                for (k = 0; k < rows; k++) {
+                    ds->obs[i + k][j] = buf[k];
+                }
+            }
+            if (!src.cols[j].mapped) {
+                free(src.cols[j].data);
+            }
+            free(src.cols[j].levels);
+        }
+        free(src.cols);
+        free(buf);
+        ds->n = src.n;
+
+        /* the rows are all in memory now, so a mapping the columns were read from can go */
+        if (ds->map != NULL) {
+            munmap(ds->map, ds->maplen);
+            ds->map = NULL;
+            ds->maplen = 0;
+        }
+    }
+
+    printlog(INFO, "Pivoted dataset '%s' to %s\n", ds->handle, (columns) ? "columns" : "rows");
+
+    return 0;
+}
+
+
+void advise_dataset (dataset *ds, int sequential) {
+
+    /***
+        Tell the kernel whether the rows of ds that live in file mappings
+        are about to be read from first to last, so that it reads ahead
+        and drops pages behind, or not.
+    ***/
+
+    int advice = (sequential) ? MADV_SEQUENTIAL : MADV_NORMAL;
+    int j;
+
+    for (j = 0; j < ds->nblocks; j++) {
+        if (ds->blocks[j].spilled) {
+            madvise(ds->blocks[j].rows, ds->blocks[j].bytes, advice);
+        }
+    }
+    if (ds->map != NULL) {
+        madvise(ds->map, ds->maplen, advice);
+    }
+
+}
+
+
+void get_values (const dataset *ds, int var, int first, int count, double *buf) {
+
+    /***
+        Copy observations first to first + count - 1 of var into buf.  The
+        type is settled once for the run, so a column is read straight
+        through, and only rows stored as rows are read a row at a time.
+    ***/
+
+    const dscolumn *c;
+    int i;
+
+    if (ds->cols == NULL) {
+        for (i = 0; i < count; i++) {
+            buf[i] = ds->obs[first + i][var];
+        }
+        return;
+    }
+
+    c = &ds->cols[var];
+    switch (c->type) {
+        case COL_DOUBLE:
+            memcpy(buf, (double *) c->data + first, count * sizeof(double));
+            break;
+        case COL_FLOAT:
+            for (i = 0; i < count; i++) {
+                buf[i] = ((float *) c->data)[first + i];
+            }
+            break;
+        case COL_CODE8:
+            for (i = 0; i < count; i++) {
+                buf[i] = c->levels[((uint8_t *) c->data)[first + i]];
+            }
+            break;
+        case COL_CODE16:
+            for (i = 0; i < count; i++) {
+                buf[i] = c->levels[((uint16_t *) c->data)[first + i]];
+            }
+            break;
+        default:
+            for (i = 0; i < count; i++) {
+                buf[i] = get_value(ds, first + i, var);
+            }
+            break;
+    }
+
+}
+
+
+int code_type (dataset *ds, int var) {
+
+    /* return the coded type that would hold var, or -1 if it cannot be coded */
+
+    double *levels;
+    int n;
+
+    if (ds->cols != NULL || (n = build_levels(ds, var, MAX_LEVELS, &levels)) < 0) {
+        return -1;
+    }
+    free(levels);
+
+    return (n <= 256) ? COL_CODE8 : COL_CODE16;
+}
+
+
+int find_coltype (char *name) {
+
+    /* return the storage type with the given name, or -1 */
+    int t;
+
+    for (t = 0; t < COL_NTYPES && strcmp(name, coltype_names[t]) != 0; t++);
+
+    return (t < COL_NTYPES) ? t : -1;
+}
+
+
+const char *coltype_name (int type) {
+
+    return (type >= 0 && type < COL_NTYPES) ? coltype_names[type] : "unknown";
+}
+
+
+size_t coltype_size (int type) {
+
+    return coltype_sizes[type];
+}
+
+
+void set_columns (dataset *ds, dscolumn *cols, int n) {
+
+    /* give ds n observations in typed columns, which it then owns, in place of its rows */
+
+    free_blocks(ds);
+    free(ds->obs);
+    if (ds->map != NULL) {
+        munmap(ds->map, ds->maplen);
+    }
+    ds->obs = NULL;
+    ds->map = NULL;
+    ds->obssize = 0;
+    ds->n = ds->size = n;
+    ds->cols = cols;
 
 }
 
@@ -389,53 +750,265 @@ int set_weight_variable (dataset *ds, int var) {
 }
 
 
+/* static function definitions */
 
+static int fits_coltype (double v, int type) {
 
-/* static function definitions */
+    /* can v be stored in type and read back unchanged? */
 
+    /* SYSMIS has a stand-in in every type */
+    if (v == SYSMIS) {
+        return 1;
+    }
 
-static int string_to_double(char *str, double* d) {
+    /* the integer types cannot keep the sign of -0, and their lowest value stands for SYSMIS */
+    switch (type) {
+        case COL_INT8:
+            return v > INT8_MIN && v <= INT8_MAX && v == (int) v && !(v == 0 && signbit(v));
+        case COL_INT16:
+            return v > INT16_MIN && v <= INT16_MAX && v == (int) v && !(v == 0 && signbit(v));
+        case COL_INT32:
+            return v > INT32_MIN && v <= INT32_MAX && v == (int32_t) v && !(v == 0 && signbit(v));
+        case COL_FLOAT:
+            return isinf(v) || (v >= -FLT_MAX && v <= FLT_MAX && v == (double) (float) v);
+        default:
+            return 1;
+    }
+}
 
-    char *endptr;
 
-    *d = strtod(str, &endptr);
+static int infer_coltype (dataset *ds, int var) {
 
-    /***
-    Possible outcomes of strtod:
-        0 Successful conversion
-        1  Successful conversion with overflow, result set to +Infinity
-        2  Successful conversion with overflow, result set to -Infinity
-        3  Successful conversion with underflow, result set to 0
-        4  Successful conversion, result parsed as NaN
-    -1  Failed conversion
-
-    pseudo code:
-    if retval == 0
-        if errno != 0 then underflow occurred, treat as successful
-        else if endptr == str then conversion failed
-        else success
-    else if retval isinf() or isnan()
-        then one of the special cases was detected
+    /* return the smallest type that holds every value of var, trying integers before float */
+
+    static const int order[] = {COL_INT8, COL_INT16, COL_INT32, COL_FLOAT};
+    int fits[COL_NTYPES];
+    int i, k, left;
+
+    for (k = 0; k < 4; k++) {
+        fits[order[k]] = 1;
+    }
+
+    /* one pass over the column, until no compact type is left */
+    for (i = 0, left = 4; i < ds->n && left > 0; i++) {
+        for (k = 0; k < 4; k++) {
+            if (fits[order[k]] && !fits_coltype(ds->obs[i][var], order[k])) {
+                fits[order[k]] = 0;
+                left--;
+            }
+        }
+    }
+
+    for (k = 0; k < 4 && !fits[order[k]]; k++);
+
+    return (k < 4) ? order[k] : COL_DOUBLE;
+}
 
+
+static void add_block (dataset *ds, int rows) {
+
+    /* allocate a block of rows, and point the next unused entries of obs into it */
+
+    double *block = NULL;
+    size_t bytes = (size_t) rows * ds->nvars * sizeof(double);
+    unsigned long long limit;
+    int spilled = 0;
+    int i;
+
+    printlog(VERBOSE, "Adding a block of %d observations to dataset '%s'\n", rows, ds->handle);
+
+    /* past the memory budget, rows go to a temporary file, and only if that fails to memory */
+    limit = strtoull(get_option("memlimit"), NULL, 10);
+    if (limit > 0 && __atomic_load_n(&rows_in_memory, __ATOMIC_RELAXED) + bytes > limit) {
+        if ((block = spill_block(bytes)) != NULL) {
+            spilled = 1;
+        }
+        else {
+            printlog(INFO, "Warning:  Could not map a temporary file for dataset '%s', keeping its rows in memory\n",
+                ds->handle);
+        }
+    }
+    if (block == NULL) {
+        block = (double *) emalloc(bytes);
+        __atomic_fetch_add(&rows_in_memory, bytes, __ATOMIC_RELAXED);
+    }
+
+    ds->blocks = (dsblock *) erealloc(ds->blocks, (ds->nblocks + 1) * sizeof(dsblock));
+    ds->blocks[ds->nblocks].rows = block;
+    ds->blocks[ds->nblocks].bytes = bytes;
+    ds->blocks[ds->nblocks].spilled = spilled;
+    ds->nblocks++;
+
+    grow_obs(ds, ds->size + rows);
+    for (i = 0; i < rows; i++) {
+        ds->obs[ds->size + i] = &block[(size_t) i * ds->nvars];
+    }
+    ds->size += rows;
+
+}
+
+
+static void grow_obs (dataset *ds, int size) {
+
+    /* the table of pointers is small next to the rows, so it simply doubles */
+
+    if (size > ds->obssize) {
+        ds->obssize = (2 * ds->obssize > size) ? 2 * ds->obssize : size;
+        ds->obs = (double **) erealloc(ds->obs, (size_t) ds->obssize * sizeof(double *));
+    }
+
+}
+
+
+static double *spill_block (size_t bytes) {
+
+    /***
+        Map a block of bytes from a new temporary file, or return NULL.
+        The file is unlinked at once, so it goes away with the mapping,
+        and its space is reserved up front, so a full disk shows up here
+        rather than as SIGBUS when a row is written.
     ***/
 
-    if (*d == 0) {
-        if (errno != 0) {
-            /* Success, underflow */
-            return 3;
+    char *dir, *path;
+    void *block;
+    int fd;
+
+    if ((dir = getenv("TMPDIR")) == NULL || dir[0] == '\0') {
+        dir = "/tmp";
+    }
+    path = (char *) emalloc(strlen(dir) + sizeof("/mlelr.XXXXXX"));
+    sprintf(path, "%s/mlelr.XXXXXX", dir);
+    fd = mkstemp(path);
+    if (fd >= 0) {
+        unlink(path);
+    }
+    free(path);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    if (posix_fallocate(fd, 0, bytes) != 0) {
+        close(fd);
+        return NULL;
+    }
+    block = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    return (block == MAP_FAILED) ? NULL : (double *) block;
+}
+
+
+static void release_dataset (dataset *ds) {
+
+    /* release everything ds owns apart from its varnames, leaving the struct itself */
+    int j;
+
+    free(ds->handle);
+    free_blocks(ds);
+    free(ds->obs);
+    if (ds->map != NULL) {
+        munmap(ds->map, ds->maplen);
+    }
+    if (ds->cols != NULL) {
+        for (j = 0; j < ds->nvars; j++) {
+            if (!ds->cols[j].mapped) {
+                free(ds->cols[j].data);
+            }
+            free(ds->cols[j].levels);
         }
-        else if (endptr - str == 0) {
-            /* FAIL */
+        free(ds->cols);
+    }
+
+}
+
+
+static void free_blocks (dataset *ds) {
+
+    /* release every block of rows, whether allocated or mapped */
+
+    int j;
+
+    for (j = 0; j < ds->nblocks; j++) {
+        if (ds->blocks[j].spilled) {
+            munmap(ds->blocks[j].rows, ds->blocks[j].bytes);
+        }
+        else {
+            free(ds->blocks[j].rows);
+            __atomic_fetch_sub(&rows_in_memory, ds->blocks[j].bytes, __ATOMIC_RELAXED);
+        }
+    }
+    free(ds->blocks);
+    ds->blocks = NULL;
+    ds->nblocks = 0;
+
+}
+
+
+static int build_levels (dataset *ds, int var, int max, double **levels) {
+
+    /***
+        Set *levels to the distinct values of var in ascending order, and
+        return how many there are.  Return -1, with *levels NULL, if there
+        are more than max, or if var holds NaN or -0: as values are matched
+        with ==, a NaN would match no level and -0 would come back as 0.
+    ***/
+
+    double *v;
+    int i, n;
+
+    *levels = NULL;
+    v = (double *) emalloc((ds->n > 0 ? ds->n : 1) * sizeof(double));
+    for (i = 0; i < ds->n; i++) {
+        v[i] = ds->obs[i][var];
+        if (isnan(v[i]) || (v[i] == 0 && signbit(v[i]))) {
+            free(v);
             return -1;
         }
+    }
+
+    qsort(v, ds->n, sizeof(double), compare_doubles);
+    for (i = n = 0; i < ds->n; i++) {
+        if (n == 0 || v[i] != v[n-1]) {
+            if (n == max) {
+                free(v);
+                return -1;
+            }
+            v[n++] = v[i];
+        }
+    }
+
+    *levels = (double *) erealloc(v, (n > 0 ? n : 1) * sizeof(double));
+
+    return n;
+}
+
+
+static int find_level (const double *levels, int nlevels, double v) {
+
+    /* return the position of v in levels, which must hold it */
+
+    int lo = 0;
+    int hi = nlevels - 1;
+    int mid;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (levels[mid] < v) {
+            lo = mid + 1;
+        }
         else {
-            /* Success */
-            return 0;
+            hi = mid;
         }
     }
-    else if (isnan(*d))           return 4;   /* Success, NaN */
-    else if (isinf(*d) && *d > 0) return 1;   /* Success, +Inf */
-    else if (isinf(*d) && *d < 0) return 2;   /* Success, -Inf */
-    else return 0;  /* Success */
 
+    return lo;
+}
+
+
+static int compare_doubles (const void *v1, const void *v2) {
+
+    double a = *(const double *) v1;
+    double b = *(const double *) v2;
+
+    return (a > b) - (a < b);
 }
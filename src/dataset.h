@@ -24,8 +24,53 @@ Copyright (C) 2015 Scott A. Czepiel
 #ifndef DATASET_H__
 #define DATASET_H__
 
+#include <stddef.h>
+#include <stdint.h>
+
 extern const double SYSMIS;
 
+/***
+    dscolumn
+
+    The values of one variable of a compacted dataset, stored in the
+    smallest type that holds all of them exactly.  In the integer types,
+    the lowest value of the type stands for SYSMIS, so that value cannot
+    be stored itself.  SYSMIS is exact in float, so float needs no such
+    stand-in.  The order of coltype is also the type code used in native
+    dataset files, so new types may only be added at the end.
+
+    The coded types store a categorical variable as a sorted dictionary of
+    its distinct values, its levels, and one code per observation giving
+    the position of its value in the dictionary.  Counting by level is
+    then an index into an array rather than a search.
+***/
+enum coltype {COL_DOUBLE, COL_FLOAT, COL_INT32, COL_INT16, COL_INT8, COL_CODE8, COL_CODE16, COL_NTYPES};
+
+/* the most levels a variable can have and still be stored as codes */
+#define MAX_LEVELS 65536
+
+typedef struct {
+    int      type;          /* one of enum coltype */
+    void    *data;          /* n values of that type */
+    double  *levels;        /* distinct values in ascending order, for a coded type, else NULL */
+    int      nlevels;       /* number of levels */
+    int      mapped;        /* 1 if data lies in the dataset's file mapping, 0 if allocated */
+} dscolumn;
+
+/***
+    dsblock
+
+    A block of rows.  Blocks are allocated in memory until the rows held
+    in memory by all datasets would pass the memlimit option, and after
+    that are mapped from a temporary file in $TMPDIR, or /tmp, which the
+    kernel pages to and from disk as the rows are used.
+***/
+typedef struct {
+    double  *rows;          /* the rows of the block */
+    size_t   bytes;         /* size of the block */
+    int      spilled;       /* 1 if mapped from a temporary file, 0 if allocated */
+} dsblock;
+
 /***
     dataset
 
@@ -34,12 +79,17 @@ extern const double SYSMIS;
 typedef struct {
     char    *handle;        /* a short label for this dataset */
     int      n;             /* number of observations */
-    int      size;          /* amount of space allocated for values */
+    int      size;          /* number of observations allocated in blocks */
     int      nvars;         /* number of variables */
     char   **varnames;      /* array of variable names */
-    double  *values;        /* array of contiguous space to store all data */
+    dsblock *blocks;        /* blocks of rows, which never move once allocated */
+    int      nblocks;       /* number of blocks */
     double **obs;           /* matrix of pointers to access each obs[i][j] */
+    int      obssize;       /* number of pointers allocated in obs */
     int      weight;        /* index of the weight variable, or -1 if none */
+    dscolumn *cols;         /* typed columns once compacted, when blocks and obs are NULL */
+    void    *map;           /* a file mapping holding rows or columns, unmapped along with the dataset, or NULL */
+    size_t   maplen;        /* length of that mapping */
 } dataset;
 
 struct dataspace {
@@ -60,14 +110,84 @@ extern struct dataspace dataspace;
 /* forward declarations for publically available functions defined in dataset.c */
 
 extern void init_dataspace (void);
-extern int import_dataset (char *handle, char *filename, char delim);
 extern dataset *add_dataset (char *handle, int nvars, char **varnames, int is_public);
 extern void add_observation (dataset *ds, double *obs);
+extern void add_observations (dataset *ds, double *obs, int count);
+extern double *new_observation (dataset *ds);
+extern void reserve_observations (dataset *ds, int count);
+extern void move_observations (dataset *ds, dataset *src);
+extern void attach_observations (dataset *ds, double *rows, int count, void *map, size_t maplen);
+extern void free_dataset (dataset *ds);
+extern int drop_dataset (char *handle);
 extern void print_dataset (dataset *ds, int n, int header);
 extern dataset *find_dataset (char *handle);
 extern int find_varname (dataset *ds, char *varname);
 extern int set_weight_variable (dataset *ds, int var);
 extern int find_observation(dataset *ds, double *obs, int n_vars);
 extern void sort_dataset(dataset *ds, int n_cols);
+extern int compact_dataset (dataset *ds, int *types);
+extern int find_coltype (char *name);
+extern const char *coltype_name (int type);
+extern size_t coltype_size (int type);
+extern void set_columns (dataset *ds, dscolumn *cols, int n);
+extern int code_type (dataset *ds, int var);
+extern int pivot_dataset (dataset *ds, int columns);
+extern void get_values (const dataset *ds, int var, int first, int count, double *buf);
+extern void advise_dataset (dataset *ds, int sequential);
+
+
+/***
+    get_value
+
+    Return observation i of variable j, whichever way ds is stored.  Code
+    that reads a dataset it did not build itself should use this rather
+    than ds->obs, which is NULL once a dataset is compacted.  Compacted
+    datasets are complete, so add_observation, find_observation and
+    sort_dataset only apply to datasets that are still stored as rows.
+***/
+static inline double get_value (const dataset *ds, int i, int j) {
+
+    const dscolumn *c;
+
+    if (ds->cols == NULL) {
+        return ds->obs[i][j];
+    }
+
+    c = &ds->cols[j];
+    switch (c->type) {
+        case COL_INT8:
+            return (((int8_t *) c->data)[i] == INT8_MIN) ? SYSMIS : ((int8_t *) c->data)[i];
+        case COL_INT16:
+            return (((int16_t *) c->data)[i] == INT16_MIN) ? SYSMIS : ((int16_t *) c->data)[i];
+        case COL_INT32:
+            return (((int32_t *) c->data)[i] == INT32_MIN) ? SYSMIS : ((int32_t *) c->data)[i];
+        case COL_FLOAT:
+            return ((float *) c->data)[i];
+        case COL_CODE8:
+            return c->levels[((uint8_t *) c->data)[i]];
+        case COL_CODE16:
+            return c->levels[((uint16_t *) c->data)[i]];
+        default:
+            return ((double *) c->data)[i];
+    }
+}
+
+
+/***
+    is_coded, get_code
+
+    Whether variable j is stored as codes, and if so the code of
+    observation i, which indexes ds->cols[j].levels.
+***/
+static inline int is_coded (const dataset *ds, int j) {
+
+    return ds->cols != NULL && (ds->cols[j].type == COL_CODE8 || ds->cols[j].type == COL_CODE16);
+}
+
+static inline int get_code (const dataset *ds, int i, int j) {
+
+    return (ds->cols[j].type == COL_CODE8) ? ((uint8_t *) ds->cols[j].data)[i]
+        : ((uint16_t *) ds->cols[j].data)[i];
+}
 
 #endif
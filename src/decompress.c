@@ -0,0 +1,417 @@
+/* decompress.c */
+
+/*
+
+Copyright (C) 2015 Scott A. Czepiel
+
+    This file is part of mlelr.
+
+    mlelr is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    mlelr is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with mlelr.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <zlib.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#include "interface.h"
+#include "decompress.h"
+
+#define DSTREAM_BLOCKS 4                        /* blocks in the ring */
+static const int DSTREAM_BLOCK_BYTES = 1 << 20; /* decompressed bytes per block */
+static const int DSTREAM_INPUT_BYTES = 1 << 18; /* compressed bytes per read() */
+
+struct dstream {
+    int      fd;                        /* the compressed file */
+    int      compression;               /* COMPRESS_GZIP or COMPRESS_ZSTD */
+    char    *blocks[DSTREAM_BLOCKS];    /* ring of decompressed blocks */
+    long     len[DSTREAM_BLOCKS];       /* bytes used in each block */
+    int      head;                      /* next block for the reader */
+    int      count;                     /* filled blocks, including one held by the reader */
+    int      held;                      /* 1 if the reader holds the block at head */
+    int      done;                      /* 1 once the decompressor has finished */
+    int      error;                     /* 1 if the input could not be decompressed */
+    int      stop;                      /* 1 to ask the decompressor to quit early */
+    pthread_mutex_t lock;
+    pthread_cond_t  filled;             /* signalled when a block is added, or at the end */
+    pthread_cond_t  freed;              /* signalled when a block is released */
+    pthread_t tid;
+
+    /* decompressor state, used only by its thread */
+    unsigned char *in;                  /* compressed input buffer */
+    long     inlen;                     /* bytes in the input buffer */
+    int      eof;                       /* 1 once read() has returned 0 */
+    int      ended;                     /* 1 if the last frame or member was complete */
+    z_stream z;
+#ifdef HAVE_ZSTD
+    ZSTD_DStream *zd;
+    ZSTD_inBuffer zin;
+#endif
+};
+
+static void *decompress_thread (void *arg);
+static long fill_gzip (dstream *s, char *out, long size);
+#ifdef HAVE_ZSTD
+static long fill_zstd (dstream *s, char *out, long size);
+#endif
+static long read_input (dstream *s);
+
+
+int detect_compression (char *filename) {
+
+    /* look for the gzip or zstd magic number at the start of the file */
+
+    unsigned char magic[4];
+    int fd;
+    ssize_t n;
+
+    if ((fd = open(filename, O_RDONLY)) < 0) {
+        return COMPRESS_NONE;
+    }
+    n = read(fd, magic, sizeof(magic));
+    close(fd);
+
+    if (n >= 2 && magic[0] == 0x1f && magic[1] == 0x8b) {
+        return COMPRESS_GZIP;
+    }
+    if (n == 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd) {
+        return COMPRESS_ZSTD;
+    }
+
+    return COMPRESS_NONE;
+}
+
+
+dstream *dstream_open (char *filename, int compression) {
+
+    /* open filename and start decompressing it, or return NULL */
+
+    dstream *s;
+    int i;
+
+#ifndef HAVE_ZSTD
+    if (compression == COMPRESS_ZSTD) {
+        printlog(INFO, "%s\n", "Error:  This build of mlelr cannot read zstd files.  Rebuild with -DHAVE_ZSTD and -lzstd.");
+        return NULL;
+    }
+#endif
+
+    s = (dstream *) emalloc(sizeof(dstream));
+    memset(s, 0, sizeof(dstream));
+    s->compression = compression;
+
+    if ((s->fd = open(filename, O_RDONLY)) < 0) {
+        printlog(INFO, "%s%s\n", "Error:  Could not open file: ", filename);
+        free(s);
+        return NULL;
+    }
+    posix_fadvise(s->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    for (i = 0; i < DSTREAM_BLOCKS; i++) {
+        s->blocks[i] = (char *) emalloc(DSTREAM_BLOCK_BYTES);
+    }
+    s->in = (unsigned char *) emalloc(DSTREAM_INPUT_BYTES);
+
+    if (compression == COMPRESS_GZIP) {
+        /* 15 + 32: largest window, and accept either a gzip or a zlib header */
+        if (inflateInit2(&s->z, 15 + 32) != Z_OK) {
+            s->error = 1;
+        }
+    }
+#ifdef HAVE_ZSTD
+    else if (compression == COMPRESS_ZSTD) {
+        if ((s->zd = ZSTD_createDStream()) == NULL || ZSTD_isError(ZSTD_initDStream(s->zd))) {
+            s->error = 1;
+        }
+    }
+#endif
+
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->filled, NULL);
+    pthread_cond_init(&s->freed, NULL);
+
+    if (s->error || pthread_create(&s->tid, NULL, decompress_thread, s) != 0) {
+        printlog(INFO, "%s%s\n", "Error:  Could not start decompressing file: ", filename);
+        s->done = 1;
+        s->tid = pthread_self();
+        dstream_close(s);
+        return NULL;
+    }
+
+    return s;
+}
+
+
+long dstream_read (dstream *s, const char **p) {
+
+    /***
+        Release the block returned by the previous call, then wait for the
+        next one.  Returns its length, 0 at the end of the stream, or -1 if
+        the input could not be decompressed.
+    ***/
+
+    long n;
+
+    pthread_mutex_lock(&s->lock);
+
+    if (s->held) {
+        s->head = (s->head + 1) % DSTREAM_BLOCKS;
+        s->count--;
+        s->held = 0;
+        pthread_cond_signal(&s->freed);
+    }
+
+    while (s->count == 0 && !s->done) {
+        pthread_cond_wait(&s->filled, &s->lock);
+    }
+
+    if (s->count == 0) {
+        n = s->error ? -1 : 0;
+    }
+    else {
+        s->held = 1;
+        *p = s->blocks[s->head];
+        n = s->len[s->head];
+    }
+
+    pthread_mutex_unlock(&s->lock);
+
+    return n;
+}
+
+
+void dstream_close (dstream *s) {
+
+    /* stop the decompressor, wait for it, and free everything */
+
+    int i;
+
+    pthread_mutex_lock(&s->lock);
+    s->stop = 1;
+    pthread_cond_signal(&s->freed);
+    pthread_mutex_unlock(&s->lock);
+
+    if (!pthread_equal(s->tid, pthread_self())) {
+        pthread_join(s->tid, NULL);
+    }
+
+    if (s->compression == COMPRESS_GZIP) {
+        inflateEnd(&s->z);
+    }
+#ifdef HAVE_ZSTD
+    if (s->zd != NULL) {
+        ZSTD_freeDStream(s->zd);
+    }
+#endif
+
+    pthread_mutex_destroy(&s->lock);
+    pthread_cond_destroy(&s->filled);
+    pthread_cond_destroy(&s->freed);
+
+    for (i = 0; i < DSTREAM_BLOCKS; i++) {
+        free(s->blocks[i]);
+    }
+    free(s->in);
+    close(s->fd);
+    free(s);
+
+}
+
+
+
+
+/* static function definitions */
+
+static void *decompress_thread (void *arg) {
+
+    /* fill free blocks of the ring until the input is exhausted */
+
+    dstream *s = (dstream *) arg;
+    int slot;
+    long n;
+
+    for (;;) {
+
+        /* wait for a free block */
+        pthread_mutex_lock(&s->lock);
+        while (s->count == DSTREAM_BLOCKS && !s->stop) {
+            pthread_cond_wait(&s->freed, &s->lock);
+        }
+        if (s->stop) {
+            pthread_mutex_unlock(&s->lock);
+            break;
+        }
+        slot = (s->head + s->count) % DSTREAM_BLOCKS;
+        pthread_mutex_unlock(&s->lock);
+
+        /* the free block is ours alone until we publish it */
+#ifdef HAVE_ZSTD
+        if (s->compression == COMPRESS_ZSTD)
+            n = fill_zstd(s, s->blocks[slot], DSTREAM_BLOCK_BYTES);
+        else
+#endif
+            n = fill_gzip(s, s->blocks[slot], DSTREAM_BLOCK_BYTES);
+
+        pthread_mutex_lock(&s->lock);
+        if (n > 0) {
+            s->len[slot] = n;
+            s->count++;
+        }
+        else if (n < 0) {
+            s->error = 1;
+        }
+        pthread_cond_signal(&s->filled);
+        pthread_mutex_unlock(&s->lock);
+
+        if (n <= 0) {
+            break;
+        }
+    }
+
+    pthread_mutex_lock(&s->lock);
+    s->done = 1;
+    pthread_cond_signal(&s->filled);
+    pthread_mutex_unlock(&s->lock);
+
+    return NULL;
+}
+
+
+static long fill_gzip (dstream *s, char *out, long size) {
+
+    /* inflate into out until it is full or the input ends */
+
+    int ret;
+
+    s->z.next_out = (unsigned char *) out;
+    s->z.avail_out = size;
+
+    while (s->z.avail_out > 0) {
+
+        if (s->z.avail_in == 0) {
+            if (read_input(s) < 0) {
+                return -1;
+            }
+            if (s->inlen == 0) {
+                break;
+            }
+            s->z.next_in = s->in;
+            s->z.avail_in = s->inlen;
+        }
+
+        /* a .gz file may hold several members one after another */
+        if (s->ended) {
+            inflateReset(&s->z);
+            s->ended = 0;
+        }
+
+        ret = inflate(&s->z, Z_NO_FLUSH);
+
+        if (ret == Z_STREAM_END) {
+            s->ended = 1;
+        }
+        else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+            printlog(INFO, "%s%s\n", "Error:  Corrupt gzip data: ", s->z.msg ? s->z.msg : "");
+            return -1;
+        }
+    }
+
+    if (s->inlen == 0 && !s->ended) {
+        printlog(INFO, "%s\n", "Error:  Compressed data ends unexpectedly.");
+        return -1;
+    }
+
+    return size - s->z.avail_out;
+}
+
+
+#ifdef HAVE_ZSTD
+static long fill_zstd (dstream *s, char *out, long size) {
+
+    /* decompress into out until it is full or the input ends */
+
+    ZSTD_outBuffer zout;
+    size_t ret;
+
+    zout.dst = out;
+    zout.size = size;
+    zout.pos = 0;
+
+    while (zout.pos < zout.size) {
+
+        if (s->zin.pos == s->zin.size) {
+            if (read_input(s) < 0) {
+                return -1;
+            }
+            if (s->inlen == 0) {
+                break;
+            }
+            s->zin.src = s->in;
+            s->zin.size = s->inlen;
+            s->zin.pos = 0;
+        }
+
+        ret = ZSTD_decompressStream(s->zd, &zout, &s->zin);
+        if (ZSTD_isError(ret)) {
+            printlog(INFO, "%s%s\n", "Error:  Corrupt zstd data: ", ZSTD_getErrorName(ret));
+            return -1;
+        }
+
+        /* 0 means a frame is complete and fully flushed */
+        s->ended = (ret == 0);
+    }
+
+    if (s->inlen == 0 && !s->ended) {
+        printlog(INFO, "%s\n", "Error:  Compressed data ends unexpectedly.");
+        return -1;
+    }
+
+    return zout.pos;
+}
+#endif
+
+
+static long read_input (dstream *s) {
+
+    /* refill the compressed input buffer; inlen is 0 at end of file */
+
+    ssize_t n;
+
+    s->inlen = 0;
+    if (s->eof) {
+        return 0;
+    }
+
+    do {
+        n = read(s->fd, s->in, DSTREAM_INPUT_BYTES);
+    } while (n < 0 && errno == EINTR);
+
+    if (n < 0) {
+        printlog(INFO, "%s\n", "Error:  Could not read compressed file.");
+        return -1;
+    }
+    if (n == 0) {
+        s->eof = 1;
+    }
+    s->inlen = n;
+
+    return 0;
+}
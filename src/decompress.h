@@ -0,0 +1,52 @@
+/* decompress.h */
+
+/*
+
+Copyright (C) 2015 Scott A. Czepiel
+
+    This file is part of mlelr.
+
+    mlelr is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    mlelr is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with mlelr.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef DECOMPRESS_H__
+#define DECOMPRESS_H__
+
+/***
+    dstream
+
+    A compressed file, decompressed on a thread of its own into a small
+    ring of fixed-size blocks.  The reader takes the blocks in order with
+    dstream_read, and the decompressor can never get more than the ring's
+    capacity ahead of it, so memory use stays bounded however large the
+    file is.
+***/
+typedef struct dstream dstream;
+
+enum compression {
+    COMPRESS_NONE,
+    COMPRESS_GZIP,
+    COMPRESS_ZSTD
+};
+
+
+/* forward declarations for publically available functions defined in decompress.c */
+
+extern int detect_compression (char *filename);
+extern dstream *dstream_open (char *filename, int compression);
+extern long dstream_read (dstream *s, const char **p);
+extern void dstream_close (dstream *s);
+
+#endif
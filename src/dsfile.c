@@ -0,0 +1,325 @@
+/* dsfile.c */
+
+/*
+
+Copyright (C) 2015 Scott A. Czepiel
+
+    This file is part of mlelr.
+
+    mlelr is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    mlelr is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with mlelr.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "dataset.h"
+#include "interface.h"
+#include "dsfile.h"
+
+/* number of rows transposed at a time, between rows and columns */
+static const int BATCH_ROWS = 4096;
+
+static int write_padding (FILE *ofp, uint64_t *pos, uint64_t align);
+
+
+int save_dataset (dataset *ds, char *filename) {
+
+    /***
+        Write ds to filename in the native column format.  The file is
+        written under a temporary name and then renamed, so a dataset
+        loaded from filename, which still maps the old file, is left
+        intact.
+    ***/
+
+    FILE *ofp;
+    char *tmpname;
+    dsfile_header hdr;
+    dsfile_column *cols;
+    uint64_t pos;
+    double *buf;
+    int i, j, k, rows;
+    int ok = 1;
+
+    printlog(INFO, "%s%s%s%s\n", "Saving dataset '", ds->handle, "' to file: ", filename);
+
+    tmpname = (char *) emalloc(strlen(filename) + strlen(".tmp") + 1);
+    strcpy(tmpname, filename);
+    strcat(tmpname, ".tmp");
+
+    if ((ofp = fopen(tmpname, "wb")) == NULL) {
+        printlog(INFO, "%s%s\n", "Error:  Could not open file for writing: ", tmpname);
+        free(tmpname);
+        return -1;
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    strcpy(hdr.magic, DSFILE_MAGIC);
+    hdr.version = DSFILE_VERSION;
+    hdr.byteorder = DSFILE_BYTEORDER;
+    hdr.nvars = ds->nvars;
+    hdr.weight = ds->weight;
+    hdr.n = ds->n;
+    hdr.names = sizeof(hdr) + ds->nvars * sizeof(dsfile_column);
+
+    /* lay out the columns after the names, each on its own aligned block */
+    cols = (dsfile_column *) emalloc(ds->nvars * sizeof(dsfile_column));
+    pos = hdr.names;
+    for (j = 0; j < ds->nvars; j++) {
+        pos += strlen(ds->varnames[j]) + 1;
+    }
+    for (j = 0; j < ds->nvars; j++) {
+        pos = (pos + DSFILE_ALIGN - 1) / DSFILE_ALIGN * DSFILE_ALIGN;
+        cols[j].offset = pos;
+        cols[j].type = (ds->cols != NULL) ? ds->cols[j].type : COL_DOUBLE;
+        cols[j].nlevels = (ds->cols != NULL) ? ds->cols[j].nlevels : 0;
+        pos += (uint64_t) ds->n * coltype_size(cols[j].type);
+        if (cols[j].nlevels > 0) {
+            pos = (pos + sizeof(double) - 1) / sizeof(double) * sizeof(double) + cols[j].nlevels * sizeof(double);
+        }
+    }
+
+    /* header, column table and names */
+    ok = ok && fwrite(&hdr, sizeof(hdr), 1, ofp) == 1;
+    ok = ok && fwrite(cols, sizeof(dsfile_column), ds->nvars, ofp) == (size_t) ds->nvars;
+    pos = hdr.names;
+    for (j = 0; ok && j < ds->nvars; j++) {
+        ok = fwrite(ds->varnames[j], strlen(ds->varnames[j]) + 1, 1, ofp) == 1;
+        pos += strlen(ds->varnames[j]) + 1;
+    }
+
+    /* each column, written as stored if compacted, else gathered from the rows a batch at a time */
+    buf = (double *) emalloc(BATCH_ROWS * sizeof(double));
+    for (j = 0; ok && j < ds->nvars; j++) {
+        ok = write_padding(ofp, &pos, DSFILE_ALIGN) == 0;
+        if (ds->cols != NULL) {
+            ok = ok && fwrite(ds->cols[j].data, coltype_size(cols[j].type), ds->n, ofp) == (size_t) ds->n;
+            pos += (uint64_t) ds->n * coltype_size(cols[j].type);
+            if (cols[j].nlevels > 0) {
+                ok = ok && write_padding(ofp, &pos, sizeof(double)) == 0;
+                ok = ok && fwrite(ds->cols[j].levels, sizeof(double), cols[j].nlevels, ofp) == cols[j].nlevels;
+                pos += cols[j].nlevels * sizeof(double);
+            }
+            continue;
+        }
+        for (i = 0; ok && i < ds->n; i += rows) {
+            rows = (ds->n - i < BATCH_ROWS) ? ds->n - i : BATCH_ROWS;
+            for (k = 0; k < rows; k++) {
+                buf[k] = ds->obs[i + k][j];
+            }
+            ok = fwrite(buf, sizeof(double), rows, ofp) == (size_t) rows;
+            pos += (uint64_t) rows * sizeof(double);
+        }
+    }
+
+    free(buf);
+    free(cols);
+
+    if (fclose(ofp) != 0 || !ok || rename(tmpname, filename) != 0) {
+        printlog(INFO, "%s%s\n", "Error:  Could not write file: ", filename);
+        remove(tmpname);
+        free(tmpname);
+        return -1;
+    }
+    free(tmpname);
+
+    printlog(INFO, "%s%d%s%d%s\n", "Saved ", ds->n, " observations of ", ds->nvars, " variables.");
+
+    return 0;
+}
+
+
+int load_dataset (char *handle, char *filename) {
+
+    /***
+        Read a file written by save_dataset into a new dataset.
+
+        The file is mapped rather than read, and nothing is parsed or
+        copied: the dataset is given the file's columns where they lie in
+        the mapping, as typed columns, and keeps the mapping until it is
+        dropped.  Only the levels of any coded column are copied.
+    ***/
+
+    int fd;
+    struct stat st;
+    const char *map;
+    const dsfile_header *hdr;
+    const dsfile_column *cols;
+    const uint8_t *code8;
+    const uint16_t *code16;
+    uint64_t levels;
+    const char *name;
+    char **varnames;
+    dataset *ds;
+    dscolumn *dscols;
+    int i, j, k, nvars;
+    double start;
+
+    printlog(INFO, "%s%s\n", "Loading dataset from file: ", filename);
+    start = seconds_now();
+
+    if ((fd = open(filename, O_RDONLY)) < 0) {
+        printlog(INFO, "%s%s\n", "Error:  Could not open file: ", filename);
+        return -1;
+    }
+
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t) sizeof(dsfile_header)) {
+        printlog(INFO, "%s%s\n", "Error:  Not a dataset file: ", filename);
+        close(fd);
+        return -1;
+    }
+
+    map = (const char *) mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        printlog(INFO, "%s%s\n", "Error:  Could not map file: ", filename);
+        return -1;
+    }
+
+    /***
+        validate everything before we trust any offset in the file
+    ***/
+
+    hdr = (const dsfile_header *) map;
+    cols = (const dsfile_column *) (map + sizeof(dsfile_header));
+
+    if (memcmp(hdr->magic, DSFILE_MAGIC, sizeof(DSFILE_MAGIC)) != 0) {
+        printlog(INFO, "%s%s\n", "Error:  Not a dataset file: ", filename);
+        munmap((void *) map, st.st_size);
+        return -1;
+    }
+    if (hdr->version < 1 || hdr->version > DSFILE_VERSION || hdr->byteorder != DSFILE_BYTEORDER) {
+        printlog(INFO, "%s%u%s%s\n", "Error:  Unsupported dataset file version ", hdr->version,
+            " or byte order in file: ", filename);
+        munmap((void *) map, st.st_size);
+        return -1;
+    }
+
+    nvars = hdr->nvars;
+    if (nvars < 1 || hdr->n < 0 || hdr->n > 0x7fffffff || hdr->weight >= nvars
+        || sizeof(dsfile_header) + (uint64_t) nvars * sizeof(dsfile_column) > (uint64_t) st.st_size
+        || hdr->names > (uint64_t) st.st_size) {
+        printlog(INFO, "%s%s\n", "Error:  Corrupt dataset file: ", filename);
+        munmap((void *) map, st.st_size);
+        return -1;
+    }
+    for (j = 0; j < nvars; j++) {
+        if (cols[j].type >= COL_NTYPES || cols[j].offset % coltype_size(cols[j].type) != 0
+            || cols[j].offset > (uint64_t) st.st_size
+            || (uint64_t) hdr->n * coltype_size(cols[j].type) > (uint64_t) st.st_size - cols[j].offset) {
+            printlog(INFO, "%s%s\n", "Error:  Corrupt dataset file: ", filename);
+            munmap((void *) map, st.st_size);
+            return -1;
+        }
+
+        /* a coded column's levels must be in the file, and every code must name one */
+        if (cols[j].type != COL_CODE8 && cols[j].type != COL_CODE16) {
+            continue;
+        }
+        levels = cols[j].offset + (uint64_t) hdr->n * coltype_size(cols[j].type);
+        levels = (levels + sizeof(double) - 1) / sizeof(double) * sizeof(double);
+        if (cols[j].nlevels > ((cols[j].type == COL_CODE8) ? 256 : MAX_LEVELS)
+            || levels > (uint64_t) st.st_size
+            || (uint64_t) cols[j].nlevels * sizeof(double) > (uint64_t) st.st_size - levels) {
+            printlog(INFO, "%s%s\n", "Error:  Corrupt dataset file: ", filename);
+            munmap((void *) map, st.st_size);
+            return -1;
+        }
+        code8 = (const uint8_t *) (map + cols[j].offset);
+        code16 = (const uint16_t *) (map + cols[j].offset);
+        for (i = 0; i < hdr->n; i++) {
+            if (((cols[j].type == COL_CODE8) ? code8[i] : code16[i]) >= cols[j].nlevels) {
+                break;
+            }
+        }
+        if (i < hdr->n) {
+            printlog(INFO, "%s%s\n", "Error:  Corrupt dataset file: ", filename);
+            munmap((void *) map, st.st_size);
+            return -1;
+        }
+    }
+
+    /* variable names, each of which must be terminated inside the file */
+    varnames = (char **) emalloc(nvars * sizeof(char *));
+    name = map + hdr->names;
+    for (j = 0; j < nvars; j++) {
+        if (memchr(name, '\0', map + st.st_size - name) == NULL) {
+            printlog(INFO, "%s%s\n", "Error:  Corrupt dataset file: ", filename);
+            for (k = 0; k < j; k++) {
+                free(varnames[k]);
+            }
+            free(varnames);
+            munmap((void *) map, st.st_size);
+            return -1;
+        }
+        varnames[j] = estrdup((char *) name);
+        name += strlen(name) + 1;
+    }
+
+    ds = add_dataset(handle, nvars, varnames, 1);
+
+    /***
+        Every column is used where it lies in the mapping, which the
+        dataset then owns, so nothing but the levels is copied and the
+        pages are read only as the columns are.  The checks above make
+        every column aligned for its type.
+    ***/
+    dscols = (dscolumn *) emalloc(nvars * sizeof(dscolumn));
+    for (j = 0; j < nvars; j++) {
+        dscols[j].type = cols[j].type;
+        dscols[j].data = (void *) (map + cols[j].offset);
+        dscols[j].mapped = 1;
+        dscols[j].levels = NULL;
+        dscols[j].nlevels = (cols[j].type == COL_CODE8 || cols[j].type == COL_CODE16) ? cols[j].nlevels : 0;
+        if (dscols[j].nlevels > 0) {
+            levels = cols[j].offset + (uint64_t) hdr->n * coltype_size(cols[j].type);
+            levels = (levels + sizeof(double) - 1) / sizeof(double) * sizeof(double);
+            dscols[j].levels = (double *) emalloc(dscols[j].nlevels * sizeof(double));
+            memcpy(dscols[j].levels, map + levels, dscols[j].nlevels * sizeof(double));
+        }
+    }
+    set_columns(ds, dscols, hdr->n);
+    ds->map = (void *) map;
+    ds->maplen = st.st_size;
+
+    if (hdr->weight >= 0) {
+        set_weight_variable(ds, hdr->weight);
+    }
+
+    printlog(INFO, "%s%d\n", "Number of observations loaded: ", ds->n);
+    printlog(INFO, "Loaded %lld bytes in %.3f seconds\n", (long long) st.st_size, seconds_now() - start);
+
+    return 0;
+}
+
+
+static int write_padding (FILE *ofp, uint64_t *pos, uint64_t align) {
+
+    /* write zeros up to the next multiple of align, at most DSFILE_ALIGN */
+
+    static const char zeros[DSFILE_ALIGN];
+    size_t pad;
+
+    pad = (align - *pos % align) % align;
+    if (pad > 0 && fwrite(zeros, 1, pad, ofp) != pad) {
+        return -1;
+    }
+    *pos += pad;
+
+    return 0;
+}
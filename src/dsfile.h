@@ -0,0 +1,76 @@
+/* dsfile.h */
+
+/*
+
+Copyright (C) 2015 Scott A. Czepiel
+
+    This file is part of mlelr.
+
+    mlelr is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    mlelr is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with mlelr.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef DSFILE_H__
+#define DSFILE_H__
+
+/***
+    Native dataset files
+
+    A dataset written by save_dataset can be read back by load_dataset
+    without parsing any text or copying any column: the file is mapped,
+    and each column is used where it lies.  The layout, in host byte
+    order, is:
+
+        dsfile_header
+        dsfile_column[nvars]        offset and storage type of each column
+        varnames                    nvars NUL-terminated strings
+        padding to DSFILE_ALIGN
+        column 0, column 1, ...     each n values, starting on a DSFILE_ALIGN boundary
+
+    A coded column is followed, on the next 8-byte boundary, by its
+    nlevels levels as doubles.  The version is incremented whenever this
+    layout changes; version 1 files, which have no coded columns, are
+    still read.
+***/
+
+#include <stdint.h>
+
+#define DSFILE_MAGIC    "MLELRDS"
+#define DSFILE_VERSION  2
+#define DSFILE_ALIGN    4096
+#define DSFILE_BYTEORDER 0x01020304
+
+typedef struct {
+    char     magic[8];      /* DSFILE_MAGIC, NUL-terminated */
+    uint32_t version;       /* DSFILE_VERSION */
+    uint32_t byteorder;     /* DSFILE_BYTEORDER as written by this host */
+    uint32_t nvars;         /* number of variables */
+    int32_t  weight;        /* index of the weight variable, or -1 if none */
+    int64_t  n;             /* number of observations */
+    uint64_t names;         /* file offset of the variable names */
+} dsfile_header;
+
+typedef struct {
+    uint64_t offset;        /* file offset of the first value of this column */
+    uint32_t type;          /* storage type of each value, an enum coltype */
+    uint32_t nlevels;       /* number of levels of a coded column, else zero */
+} dsfile_column;
+
+
+/* forward declarations for publically available functions defined in dsfile.c */
+
+extern int save_dataset (dataset *ds, char *filename);
+extern int load_dataset (char *handle, char *filename);
+
+#endif
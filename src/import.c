@@ -0,0 +1,1725 @@
+/* import.c */
+
+/*
+
+Copyright (C) 2015 Scott A. Czepiel
+
+    This file is part of mlelr.
+
+    mlelr is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    mlelr is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with mlelr.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <time.h>
+#include <glob.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "dataset.h"
+#include "interface.h"
+#include "import.h"
+#include "csv.h"
+#include "numparse.h"
+#include "decompress.h"
+#include "rowhash.h"
+#include "sample.h"
+#include "rowindex.h"
+
+
+/* smallest byte range worth handing to a thread of its own */
+static const int MIN_CHUNK_BYTES = 1 << 16;
+
+/* records parsed between updates of the running totals, and seconds between progress reports */
+static const int PROGRESS_ROWS = 4096;
+static const double PROGRESS_SECONDS = 1.0;
+
+/* one record in this many is timed stage by stage, to keep the clock off the hot path;
+   it is odd so that the sampled records do not line up with the blocks of a dataset */
+static const int STAGE_SAMPLE = 17;
+
+enum import_stage {STAGE_IO, STAGE_TOKENIZE, STAGE_CONVERT, STAGE_STORE, NSTAGES};
+static char *stage_names[] = {"I/O", "tokenize", "convert", "store"};
+
+/***
+    import_stats
+
+    Running totals for the progress reports and the final summary of an
+    import.  Parsing threads add to bytes and rows atomically, and only
+    the main thread reports.
+***/
+typedef struct {
+    double      start;          /* when the import began */
+    double      last;           /* when progress was last reported */
+    long long   bytes;          /* bytes of input consumed */
+    long long   rows;           /* records parsed */
+    double      stage[NSTAGES]; /* seconds spent in each stage, summed over threads */
+    int         separate_io;    /* 0 if reading happens inside tokenizing and is timed with it */
+    double      clock;          /* seconds taken by one call to seconds_now, taken out of sampled times */
+} import_stats;
+
+/***
+    import_chunk
+
+    One byte range of a mapped file, parsed by one thread into its own dataset.
+***/
+typedef struct {
+    const char *start;      /* first byte of the first record in this range */
+    const char *end;        /* one past the last byte of this range */
+    char        delim;      /* field delimiter */
+    int         nfields;    /* expected number of fields per record */
+    int         nvars;      /* number of fields stored from each record */
+    const int  *cols;       /* index of the field that supplies each stored value */
+    dataset    *rows;       /* parsed observations, or the distinct ones with counts if collapsing */
+    long long   offset;     /* file offset of start, which with the seed decides which records are sampled */
+    int         file;       /* ordinal of the file the range is from, which orders a sample of several files */
+    int         n;          /* number of records read, whether or not they were sampled */
+    int         nparsed;    /* number of those records that were parsed */
+    int         limit;      /* number of records to read before stopping, or 0 for all */
+    int         sampling;   /* 1 if only some records are parsed */
+    uint64_t    seed;       /* seed for the random key of each record */
+    uint64_t    threshold;  /* a record is sampled if its key is below this, when not a reservoir */
+    reservoir   res;        /* the records sampled so far, when res.size is not 0 */
+    rowindex   *marks;      /* marks of the rows in this range by number within it, or NULL */
+    const char *failed;     /* first record that could not be parsed, or NULL */
+    int         nfailed;    /* fields found in that record, or -1 if out of memory */
+    int         collapse;   /* 1 to fold each row into rows rather than append it */
+    rowhash     index;      /* hash index over rows, when collapsing */
+    import_stats *stats;    /* totals shared by all ranges of the import */
+    double      stage[NSTAGES]; /* sampled seconds in each stage for this range */
+    int         reporter;   /* 1 if parsed on the thread that reports progress */
+    int         done;       /* set once parsing has finished */
+} import_chunk;
+
+/***
+    import_target
+
+    The dataset being imported into, and how parsed rows are added to it.
+***/
+typedef struct {
+    dataset    *ds;         /* dataset receiving the rows, NULL until the header is read */
+    int         nfields;    /* number of fields per record */
+    int         nvars;      /* number of fields stored from each record */
+    int        *cols;       /* index of the field that supplies each stored value */
+    int         collapse;   /* 1 to store each distinct row once, counting repeats in _Count */
+    rowhash     index;      /* hash index over the distinct rows of ds, when collapsing */
+    int        *types;      /* storage type of each variable once compacted, -1 to infer, or NULL */
+    int         compact;    /* 1 to infer the smallest type for each variable not declared or coded */
+    int         encode;     /* 1 to code each variable not declared that has few enough levels */
+    int         columns;    /* 1 to pivot the dataset to columns once read, if it is not compacted */
+    int         nread;      /* number of records read so far */
+    int         fileread;   /* number of those records read from the current file */
+    int         limit;      /* number of records to read before stopping, or 0 for all */
+    double      sample;     /* probability of parsing each record, 1 to parse them all */
+    uint64_t    seed;       /* seed for the random key of each record, from the seed option */
+    reservoir   res;        /* a fixed size sample of the records, when res.size is not 0 */
+    int         nsampled;   /* number of records parsed, when sampling by probability */
+    rowindex   *marks;      /* row index being built as the file is read, or NULL */
+} import_target;
+
+/***
+    import_queue
+
+    The ranges of a multi-file import, taken in turn by a pool of threads.
+***/
+typedef struct {
+    import_chunk *chunks;   /* the ranges, in the order they are appended */
+    int         nchunks;    /* number of ranges */
+    int         next;       /* index of the next range to be taken, updated atomically */
+} import_queue;
+
+
+/* static function declarations */
+static int import_mapped (char *handle, char *filename, char delim, import_spec *spec, int nthreads);
+static void *parse_chunk (void *arg);
+static int import_files (char *handle, char *pattern, char delim, import_spec *spec, int nthreads);
+static void *parse_queue (void *arg);
+static const char *match_varnames (const char *p, const char *end, char delim, char **varnames, int nvars);
+static int import_stream (char *handle, char *filename, char delim, import_spec *spec, int compression);
+static int parse_stream_records (import_target *t, char *handle, import_spec *spec,
+    const char *p, const char *end, long long offset, char delim, import_stats *stats);
+static void append_carry (char **carry, long *carrylen, long *carrysize, const char *p, long len);
+static char **read_varnames (const char **p, const char *end, char delim, int *nvars);
+static char **copy_varnames (char **varnames, int nvars);
+static int open_target (import_target *t, char *handle, char **varnames, int nfields, import_spec *spec);
+static void close_target (import_target *t, int failed);
+static int set_coltypes (int *types, char **varnames, int nvars, char *coltypes);
+static void fold_row (dataset *ds, rowhash *index, double *obs);
+static void init_chunk (import_chunk *c, const char *start, const char *end, long long offset,
+    char delim, import_target *t, import_stats *stats);
+static void free_chunk (import_chunk *c);
+static int append_chunk (import_target *t, import_chunk *c);
+static void init_stats (import_stats *stats, int separate_io);
+static void sample_stages (double *stage, double clock, double t0, double t1, double t2, double t3,
+    double t4);
+static void count_progress (import_stats *stats, long long bytes, long long rows);
+static void report_progress (import_stats *stats);
+static void report_summary (import_stats *stats, int nthreads);
+
+
+/* public function definitions */
+
+void init_import_spec (import_spec *spec) {
+
+    /* defaults for an import command with no modifiers */
+    spec->use_mmap = 0;
+    spec->collapse = 0;
+    spec->keep = NULL;
+    spec->compact = 0;
+    spec->coltypes = NULL;
+    spec->encode = 0;
+    spec->columns = 0;
+    spec->sample = 1;
+    spec->reservoir = 0;
+    spec->limit = 0;
+    spec->is_public = 1;
+    spec->ds = NULL;
+
+}
+
+
+int import_dataset (char *handle, char *filename, char delim, import_spec *spec) {
+
+    /* import a delimited text file as a new dataset */
+
+    int i, j;
+    FILE *ifp;
+    char **varnames;
+    int nvars = 0;
+    char *line;
+    double *obs, *row;
+    import_target t;
+    import_stats stats;
+    int nthreads;
+    int compression;
+    double t0 = 0, t1 = 0, t2 = 0, t3 = 0;
+    struct stat st;
+    rowindex ix;
+    long pos = 0;
+
+    /* a filename with wildcards names a set of files to import as one */
+    nthreads = atoi(get_option("threads"));
+    if (strpbrk(filename, "*?[") != NULL) {
+        return import_files(handle, filename, delim, spec, nthreads);
+    }
+
+    printlog(INFO, "%s%s\n", "Importing dataset from file: ", filename);
+
+    /* compressed files are decompressed as they are parsed */
+    compression = detect_compression(filename);
+    if (compression != COMPRESS_NONE) {
+        return import_stream(handle, filename, delim, spec, compression);
+    }
+
+    /***
+        Splitting the file among threads requires random access, so it
+        implies mmap.  So does sampling, which passes over a record by
+        finding the next newline rather than reading it field by field.
+    ***/
+    if (spec->use_mmap || nthreads > 1 || spec->sample < 1 || spec->reservoir > 0) {
+        return import_mapped(handle, filename, delim, spec, nthreads);
+    }
+
+    /* try to open file */
+    if ((ifp = fopen(filename, "r")) == NULL) {
+        printlog(INFO, "%s%s\n", "Error:  Could not open file: ", filename);
+        return -1;
+    }
+
+    /***
+        read variable names from first row
+    ***/
+
+    if (csvgetline(ifp, delim, 0) == NULL) {
+        printlog(INFO, "%s%s\n", "Error:  File is empty, ", filename);
+        return -1;
+    }
+
+    /* set number of variables to number of fields parsed */
+    if ((nvars = csvnfield()) < 1) {
+        printlog(INFO, "%s\n", "Error:  No variable names found.  Check that delimiter string is correct.");
+        return -1;
+    }
+
+    printlog(INFO, "%s%d\n", "Number of variables found: ", nvars);
+
+    /* allocate space to store variable names */
+    varnames = (char **) emalloc(nvars * sizeof(char *));
+
+    /* read in varnames */
+    printlog(INFO, "%s", "Variable names: ");
+    for (i = 0; i < nvars; i++) {
+        varnames[i] = estrdup(csvfield(i));
+        printlog(INFO, "%s ", varnames[i]);
+    }
+    printlog(INFO, "\n");
+
+    /* the index is of no use to this path, but one is built if the file has none */
+    init_rowindex(&ix);
+    if (atoi(get_option("rowindex")) && fstat(fileno(ifp), &st) == 0
+        && read_rowindex(&ix, filename, delim, &st) < 0) {
+        ix.nfields = nvars;
+        ix.varnames = copy_varnames(varnames, nvars);
+        ix.header = ftell(ifp);
+    }
+    else {
+        free_rowindex(&ix);
+    }
+
+    /***
+        add a new dataset to the dataspace
+    ***/
+
+    if (open_target(&t, handle, varnames, nvars, spec) < 0) {
+        free_rowindex(&ix);
+        fclose(ifp);
+        return -1;
+    }
+    if (ix.varnames != NULL) {
+        t.marks = &ix;
+    }
+
+    /* when collapsing, rows are parsed into a scratch row whose extra slot holds a count of one */
+    row = (double *) emalloc((t.nvars + 1) * sizeof(double));
+    row[t.nvars] = 1.0;
+
+    /* getc reads the file as csvgetline splits it, so I/O is timed as part of tokenizing */
+    init_stats(&stats, 0);
+
+    /* read the data until end of file, or until the limit */
+    for (i = 0; t.limit == 0 || i < t.limit; i++) {
+
+        if (i % STAGE_SAMPLE == 0) {
+            t0 = seconds_now();
+        }
+
+        if (t.marks != NULL && i % ROWINDEX_EVERY == 0) {
+            pos = ftell(ifp);
+        }
+
+        if ((line = csvgetline(ifp, delim, 0)) == NULL) {
+            break;
+        }
+
+        if (t.marks != NULL && i % ROWINDEX_EVERY == 0) {
+            rowindex_mark(t.marks, i, pos);
+        }
+
+        /* for each line, fail if we do not have the expected number of fields */
+        if (csvnfield() != t.nfields) {
+            printlog(INFO, "%s%d%s%d%s%d%s\n%s\n", "Error:  Invalid field count at row: ", i + 2,
+                ".  Fields expected: ", nvars, ".  Fields found: ", csvnfield(), ".  Failed record: ", line);
+            close_target(&t, 1);
+            free_rowindex(&ix);
+            free(row);
+            fclose(ifp);
+            return -1;
+        }
+
+        if (i % STAGE_SAMPLE == 0) {
+            t1 = seconds_now();
+        }
+
+        /* parse straight into a new row, unless it is to be folded into an existing one */
+        obs = (t.collapse) ? row : new_observation(t.ds);
+
+        if (i % STAGE_SAMPLE == 0) {
+            t2 = seconds_now();
+        }
+
+        /* parse the data in each kept field and store in obs */
+        for (j = 0; j < t.nvars; j++) {
+
+            if (parse_double(csvfield(t.cols[j]), strlen(csvfield(t.cols[j])), &obs[j]) < 0) {
+
+                /* set to sysmis if could not read as double,
+                   this is a debatable solution, but really
+                   only affects edge cases unlikely to come up
+                   in practice */
+                obs[j] = SYSMIS;
+            }
+        }
+
+        if (i % STAGE_SAMPLE == 0) {
+            t3 = seconds_now();
+        }
+
+        /* fold this observation into the dataset */
+        if (t.collapse) {
+            fold_row(t.ds, &t.index, obs);
+        }
+        t.nread++;
+
+        if (i % STAGE_SAMPLE == 0) {
+            sample_stages(stats.stage, stats.clock, t0, t1, t2, t3, seconds_now());
+        }
+
+        if ((i + 1) % PROGRESS_ROWS == 0) {
+            count_progress(&stats, ftell(ifp) - stats.bytes, PROGRESS_ROWS);
+            report_progress(&stats);
+        }
+
+    }
+
+    count_progress(&stats, ftell(ifp) - stats.bytes, i % PROGRESS_ROWS);
+
+    /* an index is written only once the whole file has been read */
+    if (t.marks != NULL && (t.limit == 0 || t.nread < t.limit)) {
+        ix.nrows = t.nread;
+        write_rowindex(&ix, filename, delim, &st);
+    }
+    free_rowindex(&ix);
+
+    t0 = seconds_now();
+    close_target(&t, 0);
+    stats.stage[STAGE_STORE] += seconds_now() - t0;
+    free(row);
+    fclose(ifp);
+    report_summary(&stats, 1);
+    printlog(INFO, "%s\n", "Import complete.");
+
+    return 0;
+}
+
+
+
+/* static function definitions */
+
+static int import_mapped (char *handle, char *filename, char delim, import_spec *spec, int nthreads) {
+
+    /***
+        Import by parsing the file in place from a read-only memory mapping.
+
+        The stdio path reads one char at a time through getc() and then copies
+        each line before splitting it.  Here, csvsplitbuf hands us the fields
+        as spans directly within the mapped pages, and parse_double converts
+        them where they lie.  Only quoted fields are copied, to unquote them.
+
+        Since we can see the whole file at once, we can also divide it into
+        byte ranges and give each range to its own thread.  A record never
+        spans a line, not even inside quotes (csvgetline reads a line before
+        looking at any quotes), so a range boundary is simply the byte after
+        a newline.  Each thread parses into the blocks of a private dataset,
+        and once all threads are done the blocks are handed to the dataset in
+        file order, so no row is copied after it is parsed.
+
+        When collapsing, each thread folds its range into its own table of
+        distinct rows, and those tables are folded into the dataset in file
+        order, so the distinct rows appear in the order they were first seen.
+    ***/
+
+    int fd;
+    struct stat st;
+    const char *map, *p, *end;
+    char **varnames;
+    int nvars, nchunks, k;
+    int failed = 0;
+    import_chunk *chunks;
+    pthread_t *tids;
+    int *started;
+    import_target t;
+    import_stats stats;
+    struct timespec poll = {0, 10000000};
+    double t0;
+    int i;
+    rowindex ix;
+    int indexed = 0;
+    const char *split;
+    int nranges, m;
+    long long tail = 0;
+
+    /* pages are read as the tokenizer first touches them, so I/O is timed as part of tokenizing */
+    init_stats(&stats, 0);
+
+    if ((fd = open(filename, O_RDONLY)) < 0) {
+        printlog(INFO, "%s%s\n", "Error:  Could not open file: ", filename);
+        return -1;
+    }
+
+    if (fstat(fd, &st) < 0 || st.st_size == 0) {
+        printlog(INFO, "%s%s\n", "Error:  File is empty, ", filename);
+        close(fd);
+        return -1;
+    }
+
+    map = (const char *) mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        printlog(INFO, "%s%s\n", "Error:  Could not map file: ", filename);
+        close(fd);
+        return -1;
+    }
+
+    /* we read front to back exactly once, so ask the kernel to read ahead aggressively */
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    madvise((void *) map, st.st_size, MADV_SEQUENTIAL | MADV_WILLNEED);
+
+    end = map + st.st_size;
+
+    /***
+        read variable names from first row, or from the row index if the
+        file has one that is still current
+    ***/
+
+    init_rowindex(&ix);
+    p = map;
+    if (atoi(get_option("rowindex")) && read_rowindex(&ix, filename, delim, &st) == 0) {
+        indexed = 1;
+        printlog(INFO, "%s%s%s\n", "Using row index: ", filename, ".idx");
+        printlog(INFO, "%s%d\n", "Number of variables found: ", ix.nfields);
+        printlog(INFO, "%s", "Variable names: ");
+        for (i = 0; i < ix.nfields; i++) {
+            printlog(INFO, "%s ", ix.varnames[i]);
+        }
+        printlog(INFO, "\n");
+        nvars = ix.nfields;
+        varnames = copy_varnames(ix.varnames, nvars);
+        p = map + ix.header;
+    }
+    else if ((varnames = read_varnames(&p, end, delim, &nvars)) != NULL) {
+        ix.nfields = nvars;
+        ix.varnames = copy_varnames(varnames, nvars);
+        ix.header = p - map;
+    }
+
+    if (varnames == NULL || open_target(&t, handle, varnames, nvars, spec) < 0) {
+        free_rowindex(&ix);
+        munmap((void *) map, st.st_size);
+        close(fd);
+        return -1;
+    }
+    count_progress(&stats, p - map, 0);
+
+    /* without a current index, one is built as the file is parsed */
+    if (!indexed && atoi(get_option("rowindex"))) {
+        t.marks = &ix;
+    }
+
+    /***
+        Divide the remainder of the file into one range per thread.
+
+        With a limit, the first records of the file can only be found by
+        reading from the start, unless the index gives where a row at or
+        before the limit starts.  Then the rows before that one are divided
+        as usual, and one more range reads on from there to the limit.
+    ***/
+
+    split = end;
+    if (t.limit > 0 && indexed && (m = rowindex_before(&ix, t.limit)) >= 0) {
+        split = map + ix.offsets[m];
+        tail = t.limit - ix.rows[m];
+    }
+
+    nchunks = nthreads;
+    if ((split - p) / MIN_CHUNK_BYTES < nchunks) {
+        nchunks = (split - p) / MIN_CHUNK_BYTES;
+    }
+    if (nchunks < 1 || (t.limit > 0 && split == end)) {
+        nchunks = 1;
+    }
+    nranges = nchunks + (tail > 0);
+
+    chunks = (import_chunk *) emalloc(nranges * sizeof(import_chunk));
+    tids = (pthread_t *) emalloc(nranges * sizeof(pthread_t));
+    started = (int *) emalloc(nranges * sizeof(int));
+
+    for (k = 0; k < nchunks; k++) {
+        chunks[k].start = p;
+        if (k > 0) {
+            /* start at the record following the first newline at or after the nominal split */
+            chunks[k].start = p + (split - p) / nchunks * k;
+            if (chunks[k].start < chunks[k-1].start) {
+                chunks[k].start = chunks[k-1].start;
+            }
+            chunks[k].start = memchr(chunks[k].start, '\n', split - chunks[k].start);
+            chunks[k].start = (chunks[k].start == NULL) ? split : chunks[k].start + 1;
+            chunks[k-1].end = chunks[k].start;
+        }
+        init_chunk(&chunks[k], chunks[k].start, split, chunks[k].start - map, delim, &t, &stats);
+        if (split != end) {
+            chunks[k].limit = 0;
+        }
+    }
+    if (tail > 0) {
+        init_chunk(&chunks[nchunks], split, end, split - map, delim, &t, &stats);
+        chunks[nchunks].limit = tail;
+    }
+
+    printlog(VERBOSE, "Parsing %d byte ranges on %d threads\n", nranges, nranges);
+
+    /***
+        The first range is parsed on this thread while the others run, and
+        progress is reported from here.  Once the first range is done, this
+        thread keeps reporting while it waits for the others.
+    ***/
+    for (k = 1; k < nranges; k++) {
+        started[k] = (pthread_create(&tids[k], NULL, parse_chunk, &chunks[k]) == 0);
+    }
+    chunks[0].reporter = 1;
+    parse_chunk(&chunks[0]);
+    for (k = 1; k < nranges; k++) {
+        if (started[k]) {
+            while (!__atomic_load_n(&chunks[k].done, __ATOMIC_ACQUIRE)) {
+                nanosleep(&poll, NULL);
+                report_progress(&stats);
+            }
+            pthread_join(tids[k], NULL);
+        }
+        else {
+            chunks[k].reporter = 1;
+            parse_chunk(&chunks[k]);
+        }
+    }
+
+    /* append each range to the new dataset in order */
+    t0 = seconds_now();
+    for (k = 0; k < nranges; k++) {
+        if (!failed) {
+            failed = append_chunk(&t, &chunks[k]);
+        }
+        for (i = 0; i < NSTAGES; i++) {
+            stats.stage[i] += chunks[k].stage[i];
+        }
+        free_chunk(&chunks[k]);
+    }
+
+    /* an index is written only once the whole file has been read */
+    if (t.marks != NULL && !failed && (t.limit == 0 || t.nread < t.limit)) {
+        ix.nrows = t.nread;
+        write_rowindex(&ix, filename, delim, &st);
+    }
+    free_rowindex(&ix);
+
+    munmap((void *) map, st.st_size);
+    close(fd);
+    free(chunks);
+    free(tids);
+    free(started);
+
+    close_target(&t, failed);
+    if (failed) {
+        return -1;
+    }
+
+    stats.stage[STAGE_STORE] += seconds_now() - t0;
+    report_summary(&stats, nranges);
+    printlog(INFO, "%s\n", "Import complete.");
+
+    return 0;
+}
+
+
+static int import_files (char *handle, char *pattern, char delim, import_spec *spec, int nthreads) {
+
+    /***
+        Import every file matching a wildcard pattern into one dataset.
+
+        The files are taken in sorted order of their names, and each must
+        begin with the same variable names as the first.  Each file is
+        mapped and parsed whole, as one range, by a pool of threads that
+        take the files in turn.  The ranges are appended in name order once
+        all are parsed, so the result does not depend on which thread parsed
+        which file.  With a limit, the files are instead parsed one after
+        another, and only until the limit is reached.
+    ***/
+
+    glob_t g;
+    int fd;
+    struct stat st;
+    const char **maps, **starts;
+    long long *sizes;
+    char **varnames = NULL;
+    int nvars = 0;
+    int nfiles, nworkers, k, i;
+    int failed = 0;
+    import_chunk *chunks;
+    import_queue q;
+    pthread_t *tids;
+    int *started;
+    import_target t;
+    import_stats stats;
+    struct timespec poll = {0, 10000000};
+    double t0;
+
+    if (glob(pattern, 0, NULL, &g) != 0 || g.gl_pathc == 0) {
+        printlog(INFO, "%s%s\n", "Error:  No files match: ", pattern);
+        globfree(&g);
+        return -1;
+    }
+    nfiles = g.gl_pathc;
+
+    printlog(INFO, "%s%d%s%s\n", "Importing dataset from ", nfiles, " files matching: ", pattern);
+
+    /* pages are read as the tokenizer first touches them, so I/O is timed as part of tokenizing */
+    init_stats(&stats, 0);
+
+    maps = (const char **) emalloc(nfiles * sizeof(char *));
+    starts = (const char **) emalloc(nfiles * sizeof(char *));
+    sizes = (long long *) emalloc(nfiles * sizeof(long long));
+    for (k = 0; k < nfiles; k++) {
+        maps[k] = MAP_FAILED;
+    }
+
+    /***
+        map each file, and check its variable names against the first
+    ***/
+
+    for (k = 0; k < nfiles && !failed; k++) {
+
+        printlog(VERBOSE, "%s%s\n", "Mapping file: ", g.gl_pathv[k]);
+
+        if (detect_compression(g.gl_pathv[k]) != COMPRESS_NONE) {
+            printlog(INFO, "%s%s\n", "Error:  Compressed files cannot be imported by pattern: ", g.gl_pathv[k]);
+            failed = 1;
+            break;
+        }
+        if ((fd = open(g.gl_pathv[k], O_RDONLY)) < 0) {
+            printlog(INFO, "%s%s\n", "Error:  Could not open file: ", g.gl_pathv[k]);
+            failed = 1;
+            break;
+        }
+        if (fstat(fd, &st) < 0 || st.st_size == 0) {
+            printlog(INFO, "%s%s\n", "Error:  File is empty, ", g.gl_pathv[k]);
+            close(fd);
+            failed = 1;
+            break;
+        }
+
+        sizes[k] = st.st_size;
+        maps[k] = (const char *) mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (maps[k] == MAP_FAILED) {
+            printlog(INFO, "%s%s\n", "Error:  Could not map file: ", g.gl_pathv[k]);
+            close(fd);
+            failed = 1;
+            break;
+        }
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        madvise((void *) maps[k], st.st_size, MADV_SEQUENTIAL | MADV_WILLNEED);
+        close(fd);
+
+        starts[k] = maps[k];
+        if (k == 0) {
+            failed = ((varnames = read_varnames(&starts[k], maps[k] + sizes[k], delim, &nvars)) == NULL);
+        }
+        else if ((starts[k] = match_varnames(maps[k], maps[k] + sizes[k], delim, varnames, nvars)) == NULL) {
+            printlog(INFO, "%s%s%s%s\n", "Error:  Variable names in file ", g.gl_pathv[k],
+                " do not match those in ", g.gl_pathv[0]);
+            failed = 1;
+        }
+        else {
+            count_progress(&stats, starts[k] - maps[k], 0);
+        }
+    }
+
+    /* the names are freed here only if open_target never takes them */
+    if (failed && varnames != NULL) {
+        for (i = 0; i < nvars; i++) {
+            free(varnames[i]);
+        }
+        free(varnames);
+    }
+
+    if (failed || open_target(&t, handle, varnames, nvars, spec) < 0) {
+        for (k = 0; k < nfiles; k++) {
+            if (maps[k] != MAP_FAILED) {
+                munmap((void *) maps[k], sizes[k]);
+            }
+        }
+        free(maps);
+        free(starts);
+        free(sizes);
+        globfree(&g);
+        return -1;
+    }
+
+    /***
+        Without a limit, every file is parsed before any is appended.  The
+        pool takes files in name order, and this thread takes its share
+        while reporting progress, then keeps reporting until all are done.
+    ***/
+
+    chunks = (import_chunk *) emalloc(nfiles * sizeof(import_chunk));
+    nworkers = (nthreads < nfiles) ? nthreads : nfiles;
+    if (nworkers < 1 || t.limit > 0) {
+        nworkers = 1;
+    }
+
+    if (t.limit == 0) {
+        for (k = 0; k < nfiles; k++) {
+            init_chunk(&chunks[k], starts[k], maps[k] + sizes[k], starts[k] - maps[k], delim, &t, &stats);
+            chunks[k].seed += k;
+            chunks[k].file = k;
+        }
+
+        printlog(VERBOSE, "Parsing %d files on %d threads\n", nfiles, nworkers);
+
+        q.chunks = chunks;
+        q.nchunks = nfiles;
+        q.next = 0;
+        tids = (pthread_t *) emalloc(nworkers * sizeof(pthread_t));
+        started = (int *) emalloc(nworkers * sizeof(int));
+        for (k = 1; k < nworkers; k++) {
+            started[k] = (pthread_create(&tids[k], NULL, parse_queue, &q) == 0);
+        }
+        while ((k = __atomic_fetch_add(&q.next, 1, __ATOMIC_ACQ_REL)) < nfiles) {
+            chunks[k].reporter = 1;
+            parse_chunk(&chunks[k]);
+        }
+        for (k = 0; k < nfiles; k++) {
+            while (!__atomic_load_n(&chunks[k].done, __ATOMIC_ACQUIRE)) {
+                nanosleep(&poll, NULL);
+                report_progress(&stats);
+            }
+        }
+        for (k = 1; k < nworkers; k++) {
+            if (started[k]) {
+                pthread_join(tids[k], NULL);
+            }
+        }
+        free(tids);
+        free(started);
+    }
+
+    /* append each file to the new dataset in name order, parsing it first if there is a limit */
+    for (k = 0; k < nfiles && !(t.limit > 0 && (failed || t.nread >= t.limit)); k++) {
+        if (t.limit > 0) {
+            init_chunk(&chunks[k], starts[k], maps[k] + sizes[k], starts[k] - maps[k], delim, &t, &stats);
+            chunks[k].seed += k;
+            chunks[k].file = k;
+            chunks[k].reporter = 1;
+            parse_chunk(&chunks[k]);
+        }
+        t0 = seconds_now();
+        if (!failed) {
+            t.fileread = 0;
+            if ((failed = append_chunk(&t, &chunks[k])) != 0) {
+                printlog(INFO, "%s%s\n", "Error:  The failed record is in file: ", g.gl_pathv[k]);
+            }
+        }
+        stats.stage[STAGE_STORE] += seconds_now() - t0;
+        for (i = 0; i < NSTAGES; i++) {
+            stats.stage[i] += chunks[k].stage[i];
+        }
+        free_chunk(&chunks[k]);
+    }
+
+    for (k = 0; k < nfiles; k++) {
+        munmap((void *) maps[k], sizes[k]);
+    }
+    free(chunks);
+    free(maps);
+    free(starts);
+    free(sizes);
+    globfree(&g);
+
+    t0 = seconds_now();
+    close_target(&t, failed);
+    if (failed) {
+        return -1;
+    }
+
+    stats.stage[STAGE_STORE] += seconds_now() - t0;
+    report_summary(&stats, nworkers);
+    printlog(INFO, "%s\n", "Import complete.");
+
+    return 0;
+}
+
+
+static void *parse_queue (void *arg) {
+
+    /* parse ranges from the queue until none are left */
+
+    import_queue *q = (import_queue *) arg;
+    int k;
+
+    while ((k = __atomic_fetch_add(&q->next, 1, __ATOMIC_ACQ_REL)) < q->nchunks) {
+        parse_chunk(&q->chunks[k]);
+    }
+
+    return NULL;
+}
+
+
+static const char *match_varnames (const char *p, const char *end, char delim, char **varnames, int nvars) {
+
+    /* return the record after the one at p if its fields are exactly varnames, or NULL */
+
+    csvparser *cp;
+    const csvspan *f;
+    const char *next;
+    char *buf;
+    int i;
+
+    if ((cp = csvnew()) == NULL) {
+        return NULL;
+    }
+
+    next = csvsplitbuf(cp, p, end, delim);
+    if (next != NULL && csvnspan_r(cp) != nvars) {
+        next = NULL;
+    }
+    for (i = 0; next != NULL && i < nvars; i++) {
+        f = csvspan_r(cp, i);
+        buf = (char *) emalloc(f->len + 1);
+        csvspancopy(f, buf);
+        if (strcmp(buf, varnames[i]) != 0) {
+            next = NULL;
+        }
+        free(buf);
+    }
+
+    csvfree(cp);
+
+    return next;
+}
+
+
+static int import_stream (char *handle, char *filename, char delim, import_spec *spec, int compression) {
+
+    /***
+        Import from a compressed file without decompressing it to disk.
+
+        A dstream decompresses the file on its own thread into a ring of
+        blocks, so inflating the next block overlaps with parsing this one.
+        Records are parsed in place within each block up to its last
+        newline.  The partial record after that newline is carried over and
+        completed with the start of the next block.
+    ***/
+
+    dstream *s;
+    const char *blk, *p, *nl;
+    long len;
+    char *carry = NULL;
+    long carrylen = 0;
+    long carrysize = 0;
+    long long offset = 0;
+    int failed = 0;
+    import_target t;
+    import_stats stats;
+    double t0;
+
+    /* the time spent waiting for each decompressed block is the I/O stage */
+    init_stats(&stats, 1);
+    t.ds = NULL;
+
+    if ((s = dstream_open(filename, compression)) == NULL) {
+        return -1;
+    }
+
+    printlog(INFO, "%s%s\n", "Decompressing while importing: ",
+        (compression == COMPRESS_GZIP) ? "gzip" : "zstd");
+
+    for (;;) {
+
+        t0 = seconds_now();
+        len = dstream_read(s, &blk);
+        stats.stage[STAGE_IO] += seconds_now() - t0;
+        if (failed || len <= 0) {
+            break;
+        }
+
+        /* find the last newline in the block */
+        for (nl = blk + len - 1; nl >= blk && *nl != '\n'; nl--);
+
+        p = blk;
+        if (nl >= blk) {
+
+            /* complete the record carried over from the previous block and parse it */
+            if (carrylen > 0) {
+                p = (const char *) memchr(blk, '\n', len) + 1;
+                append_carry(&carry, &carrylen, &carrysize, blk, p - blk);
+                failed = parse_stream_records(&t, handle, spec, carry, carry + carrylen,
+                    offset + (p - blk) - carrylen, delim, &stats);
+                carrylen = 0;
+            }
+
+            /* then every complete record that lies within the block */
+            if (!failed && p <= nl) {
+                failed = parse_stream_records(&t, handle, spec, p, nl + 1, offset + (p - blk), delim, &stats);
+            }
+            p = nl + 1;
+        }
+
+        /* keep the partial record for next time */
+        append_carry(&carry, &carrylen, &carrysize, p, blk + len - p);
+        offset += len;
+        report_progress(&stats);
+
+        /* there is no need to decompress past the limit */
+        if (t.ds != NULL && t.limit > 0 && t.nread >= t.limit) {
+            break;
+        }
+    }
+
+    if (len < 0) {
+        failed = 1;
+    }
+
+    /* the last record need not end with a newline */
+    if (!failed && carrylen > 0) {
+        failed = parse_stream_records(&t, handle, spec, carry, carry + carrylen, offset - carrylen,
+            delim, &stats);
+    }
+
+    dstream_close(s);
+    free(carry);
+
+    if (t.ds == NULL) {
+        if (!failed) {
+            printlog(INFO, "%s%s\n", "Error:  File is empty, ", filename);
+        }
+        return -1;
+    }
+
+    t0 = seconds_now();
+    close_target(&t, failed);
+    if (failed) {
+        return -1;
+    }
+
+    stats.stage[STAGE_STORE] += seconds_now() - t0;
+    report_summary(&stats, 1);
+    printlog(INFO, "%s\n", "Import complete.");
+
+    return 0;
+}
+
+
+static int parse_stream_records (import_target *t, char *handle, import_spec *spec,
+    const char *p, const char *end, long long offset, char delim, import_stats *stats) {
+
+    /***
+        Parse complete records from a decompressed block, starting with the
+        header if not yet seen.  The offset of p in the decompressed stream
+        decides which records are sampled, as the file offset does when the
+        file is mapped.
+    ***/
+
+    import_chunk c;
+    char **varnames;
+    const char *header = p;
+    int nvars;
+    int failed;
+    int i;
+    double t0;
+
+    if (t->ds == NULL) {
+        if ((varnames = read_varnames(&p, end, delim, &nvars)) == NULL) {
+            return -1;
+        }
+        if (open_target(t, handle, varnames, nvars, spec) < 0) {
+            return -1;
+        }
+        count_progress(stats, p - header, 0);
+        offset += p - header;
+    }
+
+    if (t->limit > 0 && t->nread >= t->limit) {
+        return 0;
+    }
+
+    init_chunk(&c, p, end, offset, delim, t, stats);
+    c.reporter = 1;
+    parse_chunk(&c);
+
+    t0 = seconds_now();
+    failed = append_chunk(t, &c);
+    stats->stage[STAGE_STORE] += seconds_now() - t0;
+    for (i = 0; i < NSTAGES; i++) {
+        stats->stage[i] += c.stage[i];
+    }
+    free_chunk(&c);
+
+    return failed;
+}
+
+
+static void append_carry (char **carry, long *carrylen, long *carrysize, const char *p, long len) {
+
+    /* append len bytes at p to the carried partial record */
+
+    if (*carrylen + len > *carrysize) {
+        *carrysize = 2 * (*carrylen + len);
+        *carry = (char *) erealloc(*carry, *carrysize);
+    }
+    memcpy(*carry + *carrylen, p, len);
+    *carrylen += len;
+
+}
+
+
+static char **read_varnames (const char **p, const char *end, char delim, int *nvars) {
+
+    /* parse the record at *p as variable names and advance *p past it, or return NULL */
+
+    csvparser *cp;
+    const csvspan *f;
+    char **varnames;
+    const char *next;
+    int i;
+
+    cp = csvnew();
+    next = (cp == NULL) ? NULL : csvsplitbuf(cp, *p, end, delim);
+
+    /* set number of variables to number of fields parsed */
+    if (next == NULL || (*nvars = csvnspan_r(cp)) < 1) {
+        printlog(INFO, "%s\n", "Error:  No variable names found.  Check that delimiter string is correct.");
+        csvfree(cp);
+        return NULL;
+    }
+
+    printlog(INFO, "%s%d\n", "Number of variables found: ", *nvars);
+
+    /* allocate space to store variable names */
+    varnames = (char **) emalloc(*nvars * sizeof(char *));
+
+    /* read in varnames */
+    printlog(INFO, "%s", "Variable names: ");
+    for (i = 0; i < *nvars; i++) {
+        f = csvspan_r(cp, i);
+        varnames[i] = (char *) emalloc(f->len + 1);
+        csvspancopy(f, varnames[i]);
+        printlog(INFO, "%s ", varnames[i]);
+    }
+    printlog(INFO, "\n");
+
+    csvfree(cp);
+    *p = next;
+
+    return varnames;
+}
+
+
+static char **copy_varnames (char **varnames, int nvars) {
+
+    char **copy;
+    int i;
+
+    copy = (char **) emalloc(nvars * sizeof(char *));
+    for (i = 0; i < nvars; i++) {
+        copy[i] = estrdup(varnames[i]);
+    }
+
+    return copy;
+}
+
+
+static int open_target (import_target *t, char *handle, char **varnames, int nfields, import_spec *spec) {
+
+    /***
+        Add the dataset that rows will be appended to, holding only the kept
+        variables, and with a trailing _Count if collapsing.  The varnames
+        of dropped fields are freed, and those of kept fields are handed on
+        to the dataset.  Return -1 if a kept variable is not in the file.
+    ***/
+
+    char *keep, *name;
+    int *kept;
+    int nvars, j;
+
+    t->nfields = nfields;
+    t->cols = (int *) emalloc(nfields * sizeof(int));
+
+    /* mark each field named in the keep list */
+    kept = (int *) emalloc(nfields * sizeof(int));
+    for (j = 0; j < nfields; j++) {
+        kept[j] = (spec->keep == NULL);
+    }
+    if (spec->keep != NULL) {
+        keep = estrdup(spec->keep);
+        for (name = strtok(keep, ","); name != NULL; name = strtok(NULL, ",")) {
+            for (j = 0; j < nfields && strcmp(varnames[j], name) != 0; j++);
+            if (j == nfields) {
+                printlog(INFO, "%s%s\n", "Error:  Variable not found in file: ", name);
+                break;
+            }
+            kept[j] = 1;
+        }
+        free(keep);
+        if (name != NULL) {
+            for (j = 0; j < nfields; j++) {
+                free(varnames[j]);
+            }
+            free(varnames);
+            free(kept);
+            free(t->cols);
+            t->ds = NULL;
+            return -1;
+        }
+    }
+
+    /* list the kept fields in file order, and drop the names of the rest */
+    for (j = nvars = 0; j < nfields; j++) {
+        if (kept[j]) {
+            t->cols[nvars] = j;
+            varnames[nvars++] = varnames[j];
+        }
+        else {
+            free(varnames[j]);
+        }
+    }
+    free(kept);
+
+    if (nvars < nfields) {
+        printlog(INFO, "Keeping %d of %d variables\n", nvars, nfields);
+    }
+
+    t->nvars = nvars;
+    t->collapse = spec->collapse;
+    t->nread = 0;
+    t->fileread = 0;
+    t->types = NULL;
+    t->encode = spec->encode;
+    t->compact = spec->compact;
+    t->columns = spec->columns;
+
+    /* check declared storage types now, rather than after reading the whole file */
+    if (spec->compact || spec->encode) {
+        t->types = (int *) emalloc((nvars + 1) * sizeof(int));
+        for (j = 0; j <= nvars; j++) {
+            t->types[j] = -1;
+        }
+        if (spec->coltypes != NULL && set_coltypes(t->types, varnames, nvars, spec->coltypes) < 0) {
+            for (j = 0; j < nvars; j++) {
+                free(varnames[j]);
+            }
+            free(varnames);
+            free(t->types);
+            free(t->cols);
+            t->ds = NULL;
+            return -1;
+        }
+    }
+
+    t->limit = spec->limit;
+    t->sample = spec->sample;
+    t->seed = strtoull(get_option("seed"), NULL, 10);
+    t->nsampled = 0;
+    t->marks = NULL;
+    t->res.size = 0;
+    if (spec->reservoir > 0) {
+        init_reservoir(&t->res, spec->reservoir, nvars + t->collapse);
+    }
+
+    if (t->collapse) {
+        varnames = (char **) erealloc(varnames, (nvars + 1) * sizeof(char *));
+        varnames[nvars] = estrdup("_Count");
+        init_rowhash(&t->index, nvars);
+        t->ds = add_dataset(handle, nvars + 1, varnames, spec->is_public);
+    }
+    else {
+        t->ds = add_dataset(handle, nvars, varnames, spec->is_public);
+    }
+    spec->ds = t->ds;
+
+    return 0;
+}
+
+
+static void close_target (import_target *t, int failed) {
+
+    /* add any reservoir sample, report the rows read, and weight a collapsed dataset by its counts */
+
+    double **rows;
+    int i, j;
+
+    if (!failed) {
+        printlog(INFO, "%s%d\n", "Number of observations read: ", t->nread);
+        if (t->res.size > 0) {
+            printlog(INFO, "%s%d\n", "Number of observations sampled: ", t->res.rows->n);
+        }
+        else if (t->sample < 1) {
+            printlog(INFO, "%s%d\n", "Number of observations sampled: ", t->nsampled);
+        }
+    }
+
+    free(t->cols);
+
+    /* the sample is added in file order, as if it had been read with the rest left out */
+    if (t->res.size > 0) {
+        if (!failed) {
+            rows = reservoir_rows(&t->res);
+            for (i = 0; i < t->res.rows->n; i++) {
+                if (t->collapse) {
+                    fold_row(t->ds, &t->index, rows[i]);
+                }
+                else {
+                    add_observation(t->ds, rows[i]);
+                }
+            }
+            free(rows);
+        }
+        free_reservoir(&t->res);
+    }
+
+    if (t->collapse) {
+        free_rowhash(&t->index);
+        if (!failed) {
+            printlog(INFO, "%s%d\n", "Number of distinct observations: ", t->ds->n);
+            set_weight_variable(t->ds, t->nvars);
+        }
+    }
+
+    if (t->types != NULL) {
+        if (!failed) {
+            /* the counts of a collapsed dataset are never coded */
+            for (j = 0; j < t->ds->nvars; j++) {
+                if (t->types[j] < 0 && t->encode && j < t->nvars) {
+                    t->types[j] = code_type(t->ds, j);
+                }
+                if (t->types[j] < 0 && !t->compact) {
+                    t->types[j] = COL_DOUBLE;
+                }
+            }
+            compact_dataset(t->ds, t->types);
+        }
+        free(t->types);
+    }
+    else if (t->columns && !failed) {
+        pivot_dataset(t->ds, 1);
+    }
+
+}
+
+
+static int set_coltypes (int *types, char **varnames, int nvars, char *coltypes) {
+
+    /* set types[j] for each var:type in the list, or return -1 if one is not valid */
+
+    char *list, *decl, *type;
+    int j;
+    int ret = 0;
+
+    list = estrdup(coltypes);
+    for (decl = strtok(list, ","); decl != NULL && ret == 0; decl = strtok(NULL, ",")) {
+        if ((type = strchr(decl, ':')) == NULL) {
+            printlog(INFO, "%s%s\n", "Error:  Expected var:type in compact declaration: ", decl);
+            ret = -1;
+            break;
+        }
+        *type++ = '\0';
+        for (j = 0; j < nvars && strcmp(varnames[j], decl) != 0; j++);
+        if (j == nvars) {
+            printlog(INFO, "%s%s\n", "Error:  Variable not found in file: ", decl);
+            ret = -1;
+        }
+        else if ((types[j] = find_coltype(type)) < 0) {
+            printlog(INFO, "%s%s%s\n", "Error:  Unknown storage type: ", type,
+                ".  Types are double, float32, int32, int16, int8, code8 and code16.");
+            ret = -1;
+        }
+    }
+    free(list);
+
+    return ret;
+}
+
+
+static void fold_row (dataset *ds, rowhash *index, double *obs) {
+
+    /***
+        Add obs to ds unless a row with the same key is already there, in
+        which case add its count to that row instead.  The key is the first
+        index->width values of obs, and the count follows them.
+    ***/
+
+    int row;
+
+    if ((row = rowhash_find(index, ds, obs)) >= 0) {
+        ds->obs[row][index->width] += obs[index->width];
+    }
+    else {
+        add_observation(ds, obs);
+        rowhash_add(index, ds, ds->n - 1);
+    }
+
+}
+
+
+static void init_chunk (import_chunk *c, const char *start, const char *end, long long offset,
+    char delim, import_target *t, import_stats *stats) {
+
+    int i;
+
+    c->start = start;
+    c->file = 0;
+    c->end = end;
+    c->offset = offset;
+    c->delim = delim;
+    c->nfields = t->nfields;
+    c->nvars = t->nvars;
+    c->cols = t->cols;
+    c->n = 0;
+    c->nparsed = 0;
+    c->limit = (t->limit > 0) ? t->limit - t->nread : 0;
+    c->failed = NULL;
+    c->nfailed = 0;
+    c->collapse = t->collapse;
+    c->stats = stats;
+    c->reporter = 0;
+    c->done = 0;
+    for (i = 0; i < NSTAGES; i++) {
+        c->stage[i] = 0;
+    }
+
+    /* the private dataset is made here rather than on the parsing thread */
+    c->rows = add_dataset("_import_chunk", c->nvars + c->collapse, NULL, 0);
+    if (c->collapse) {
+        init_rowhash(&c->index, c->nvars);
+    }
+
+    /* each range keeps its own reservoir, and these are merged into the target's */
+    c->seed = t->seed;
+    c->sampling = (t->sample < 1 || t->res.size > 0);
+    c->threshold = (t->sample < 1) ? (uint64_t) ldexp(t->sample, 64) : UINT64_MAX;
+    c->res.size = 0;
+    if (t->res.size > 0) {
+        init_reservoir(&c->res, t->res.size, c->nvars + c->collapse);
+    }
+
+    c->marks = NULL;
+    if (t->marks != NULL) {
+        c->marks = (rowindex *) emalloc(sizeof(rowindex));
+        init_rowindex(c->marks);
+    }
+
+}
+
+
+static void free_chunk (import_chunk *c) {
+
+    free_dataset(c->rows);
+    if (c->collapse) {
+        free_rowhash(&c->index);
+    }
+    if (c->res.size > 0) {
+        free_reservoir(&c->res);
+    }
+    if (c->marks != NULL) {
+        free_rowindex(c->marks);
+        free(c->marks);
+    }
+
+}
+
+
+static int append_chunk (import_target *t, import_chunk *c) {
+
+    /* append a parsed range to the target, and report its bad record if it has one */
+
+    int linelen;
+    int i;
+
+    /* parsed rows are handed over in the blocks they were parsed into, without a copy */
+    if (c->res.size > 0) {
+        merge_reservoir(&t->res, &c->res);
+    }
+    else if (c->collapse) {
+        for (i = 0; i < c->rows->n; i++) {
+            fold_row(t->ds, &t->index, c->rows->obs[i]);
+        }
+    }
+    else {
+        move_observations(t->ds, c->rows);
+    }
+    if (c->marks != NULL) {
+        for (i = 0; i < c->marks->nmarks; i++) {
+            rowindex_mark(t->marks, t->nread + c->marks->rows[i], c->marks->offsets[i]);
+        }
+    }
+    t->nread += c->n;
+    t->fileread += c->n;
+    t->nsampled += c->nparsed;
+
+    if (c->failed == NULL) {
+        return 0;
+    }
+
+    /* this is the record the stdio path would have stopped at, so it has the same row number */
+    if (c->nfailed < 0) {
+        printlog(INFO, "%s%d\n", "Error:  Out of memory splitting row: ", t->fileread + 2);
+    }
+    else {
+        for (linelen = 0; c->failed + linelen < c->end && c->failed[linelen] != '\n'
+            && c->failed[linelen] != '\r'; linelen++);
+        printlog(INFO, "%s%d%s%d%s%d%s\n%.*s\n", "Error:  Invalid field count at row: ", t->fileread + 2,
+            ".  Fields expected: ", c->nfields, ".  Fields found: ", c->nfailed, ".  Failed record: ",
+            linelen, c->failed);
+    }
+
+    return -1;
+}
+
+
+static void *parse_chunk (void *arg) {
+
+    /* parse one byte range of a mapped file into the range's own dataset */
+
+    import_chunk *c = (import_chunk *) arg;
+    csvparser *cp;
+    const csvspan *f;
+    const char *p, *line;
+    const char *counted;
+    char *buf;
+    int buflen;
+    int nfield, j, ret;
+    int timed;
+    int ncounted = 0;
+    uint64_t key = 0;
+    double *obs;
+    double *row = NULL;
+    double t0 = 0, t1 = 0, t2 = 0, t3 = 0;
+
+    if ((cp = csvnew()) == NULL) {
+        c->failed = c->start;
+        c->nfailed = -1;
+        __atomic_store_n(&c->done, 1, __ATOMIC_RELEASE);
+        return NULL;
+    }
+
+    buflen = 64;
+    buf = (char *) emalloc(buflen);
+
+    /* when collapsing, each row is parsed into a scratch row that carries a count of one */
+    if (c->collapse) {
+        row = (double *) emalloc((c->nvars + 1) * sizeof(double));
+        row[c->nvars] = 1.0;
+    }
+
+    for (p = counted = c->start; p < c->end && (c->limit == 0 || c->n < c->limit); c->n++) {
+
+        if (c->n - ncounted == PROGRESS_ROWS) {
+            count_progress(c->stats, p - counted, PROGRESS_ROWS);
+            counted = p;
+            ncounted = c->n;
+            if (c->reporter) {
+                report_progress(c->stats);
+            }
+        }
+
+        if (c->marks != NULL && c->n % ROWINDEX_EVERY == 0) {
+            rowindex_mark(c->marks, c->n, c->offset + (p - c->start));
+        }
+
+        /* a record left out of the sample is passed over without being split or converted */
+        if (c->sampling) {
+            key = sample_key(c->seed, c->offset + (p - c->start));
+            if ((c->res.size > 0) ? !reservoir_wants(&c->res, key) : key >= c->threshold) {
+                p = memchr(p, '\n', c->end - p);
+                p = (p == NULL) ? c->end : p + 1;
+                continue;
+            }
+        }
+
+        if ((timed = (c->nparsed % STAGE_SAMPLE == 0))) {
+            t0 = seconds_now();
+        }
+
+        line = p;
+        if ((p = csvsplitbuf(cp, p, c->end, c->delim)) == NULL) {
+            c->failed = line;
+            c->nfailed = -1;
+            break;
+        }
+
+        /* stop at the first record that does not have the expected number of fields */
+        if ((nfield = csvnspan_r(cp)) != c->nfields) {
+            c->failed = line;
+            c->nfailed = nfield;
+            break;
+        }
+
+        if (timed) {
+            t1 = seconds_now();
+        }
+
+        /* parse straight into a new row, unless it is to be folded into an existing one */
+        if (c->res.size > 0) {
+            obs = reservoir_slot(&c->res, key, c->file, c->offset + (line - c->start));
+        }
+        else {
+            obs = (c->collapse) ? row : new_observation(c->rows);
+        }
+
+        if (timed) {
+            t2 = seconds_now();
+        }
+
+        /* parse the data in each kept field and store in obs; the
+           spans of other fields are never copied or converted */
+        for (j = 0; j < c->nvars; j++) {
+
+            f = csvspan_r(cp, c->cols[j]);
+
+            /* unquoted fields are converted straight from the mapping,
+               quoted fields must first be copied to remove the quotes */
+            if (f->quoted) {
+                if (f->len >= buflen) {
+                    buflen = 2 * f->len;
+                    buf = (char *) erealloc(buf, buflen);
+                }
+                ret = parse_double(buf, csvspancopy(f, buf), &obs[j]);
+            }
+            else {
+                ret = parse_double(f->p, f->len, &obs[j]);
+            }
+
+            /* as in the stdio path, set to sysmis if could not read as double */
+            if (ret < 0) {
+                obs[j] = SYSMIS;
+            }
+        }
+
+        if (timed) {
+            t3 = seconds_now();
+        }
+
+        /* reservoir rows are folded only once the sample is complete */
+        if (c->res.size > 0) {
+            if (c->collapse) {
+                obs[c->nvars] = 1.0;
+            }
+        }
+        else if (c->collapse) {
+            fold_row(c->rows, &c->index, obs);
+        }
+        c->nparsed++;
+
+        /* a timed record stands for STAGE_SAMPLE parsed records */
+        if (timed) {
+            sample_stages(c->stage, c->stats->clock, t0, t1, t2, t3, seconds_now());
+        }
+    }
+
+    /* the bytes of a failed record are not counted */
+    count_progress(c->stats, ((c->failed != NULL) ? c->failed : p) - counted, c->n - ncounted);
+
+    free(row);
+    free(buf);
+    csvfree(cp);
+
+    __atomic_store_n(&c->done, 1, __ATOMIC_RELEASE);
+
+    return NULL;
+}
+
+
+static void init_stats (import_stats *stats, int separate_io) {
+
+    int i;
+    double t0;
+
+    stats->start = stats->last = seconds_now();
+    stats->bytes = 0;
+    stats->rows = 0;
+    for (i = 0; i < NSTAGES; i++) {
+        stats->stage[i] = 0;
+    }
+    stats->separate_io = separate_io;
+
+    /* a sampled record is timed with a few calls to the clock, so the clock must not be counted in it */
+    t0 = seconds_now();
+    for (i = 0; i < 1000; i++) {
+        seconds_now();
+    }
+    stats->clock = (seconds_now() - t0) / 1001;
+
+}
+
+
+static void sample_stages (double *stage, double clock, double t0, double t1, double t2, double t3,
+    double t4) {
+
+    /***
+        Add the stage times of one sampled record, which stands for
+        STAGE_SAMPLE records.  It was tokenized from t0 to t1, given a row
+        from t1 to t2, converted from t2 to t3 and stored from t3 to t4.
+    ***/
+
+    stage[STAGE_TOKENIZE] += STAGE_SAMPLE * fmax(t1 - t0 - clock, 0);
+    stage[STAGE_STORE] += STAGE_SAMPLE * (fmax(t2 - t1 - clock, 0) + fmax(t4 - t3 - clock, 0));
+    stage[STAGE_CONVERT] += STAGE_SAMPLE * fmax(t3 - t2 - clock, 0);
+
+}
+
+
+static void count_progress (import_stats *stats, long long bytes, long long rows) {
+
+    /* add to the running totals, from whichever thread did the work */
+    __atomic_fetch_add(&stats->bytes, bytes, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stats->rows, rows, __ATOMIC_RELAXED);
+
+}
+
+
+static void report_progress (import_stats *stats) {
+
+    /* report the running totals, at most once every PROGRESS_SECONDS */
+
+    double now = seconds_now();
+    double elapsed = now - stats->start;
+    long long bytes, rows;
+
+    if (now - stats->last < PROGRESS_SECONDS) {
+        return;
+    }
+    stats->last = now;
+
+    bytes = __atomic_load_n(&stats->bytes, __ATOMIC_RELAXED);
+    rows = __atomic_load_n(&stats->rows, __ATOMIC_RELAXED);
+
+    printlog(INFO, "Progress: %lld rows, %.1f MB in %.1f seconds (%.0f rows/sec, %.1f MB/sec)\n",
+        rows, bytes / 1048576.0, elapsed, rows / elapsed, bytes / elapsed / 1048576.0);
+
+}
+
+
+static void report_summary (import_stats *stats, int nthreads) {
+
+    /***
+        Report the totals for the whole import, and how its time divides
+        among the stages.  Stage times other than I/O and the final storage
+        step come from timing one record in STAGE_SAMPLE, and are summed
+        over the threads, so with several threads they add up to more than
+        the elapsed time.
+    ***/
+
+    double elapsed = seconds_now() - stats->start;
+    int i;
+
+    if (elapsed <= 0) {
+        elapsed = 1e-9;
+    }
+
+    printlog(INFO, "Imported %lld rows, %.1f MB in %.3f seconds (%.0f rows/sec, %.1f MB/sec)\n",
+        stats->rows, stats->bytes / 1048576.0, elapsed, stats->rows / elapsed,
+        stats->bytes / elapsed / 1048576.0);
+
+    printlog(INFO, "Seconds by stage%s:", (nthreads > 1) ? " (summed over threads)" : "");
+    for (i = 0; i < NSTAGES; i++) {
+        if (i == STAGE_IO && !stats->separate_io) {
+            printlog(INFO, "  %s within tokenize", stage_names[i]);
+        }
+        else {
+            printlog(INFO, "  %s %.3f", stage_names[i], stats->stage[i]);
+        }
+    }
+    printlog(INFO, "\n");
+
+}
@@ -0,0 +1,53 @@
+/* import.h */
+
+/*
+
+Copyright (C) 2015 Scott A. Czepiel
+
+    This file is part of mlelr.
+
+    mlelr is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    mlelr is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with mlelr.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef IMPORT_H__
+#define IMPORT_H__
+
+/***
+    import_spec
+
+    Optional modifiers that may follow the delimiter on the import command.
+***/
+typedef struct {
+    int      use_mmap;      /* 1 to parse fields in place from a memory mapping of the file */
+    int      collapse;      /* 1 to store each distinct row once, counting repeats in _Count */
+    char    *keep;          /* comma-separated names of the only variables to store, or NULL for all */
+    int      compact;       /* 1 to store each variable in the smallest type that holds it */
+    char    *coltypes;      /* comma-separated var:type declarations for compact, or NULL */
+    int      encode;        /* 1 to store each variable with few enough levels as codes into its sorted levels */
+    int      columns;       /* 1 to store the dataset a column per variable rather than a row per observation */
+    double   sample;        /* probability of keeping each record, 1 to keep them all */
+    int      reservoir;     /* number of records to keep, chosen uniformly at random, or 0 */
+    int      limit;         /* number of records to read from the start of the file, or 0 for all */
+    int      is_public;     /* 0 to keep the dataset out of the dataspace, for the caller to free */
+    dataset *ds;            /* set to the new dataset once it is created, even if the import then fails */
+} import_spec;
+
+
+/* forward declarations for publically available functions defined in import.c */
+
+extern void init_import_spec (import_spec *spec);
+extern int import_dataset (char *handle, char *filename, char delim, import_spec *spec);
+
+#endif
@@ -26,12 +26,17 @@ Copyright (C) 2015 Scott A. Czepiel
 #include <string.h>
 #include <errno.h>
 #include <stdarg.h>
+#include <time.h>
 #include "interface.h"
 #include "dataset.h"
+#include "arena.h"
 #include "model.h"
 #include "csv.h"
 #include "mlelr.h"
 #include "tabulate.h"
+#include "import.h"
+#include "dsfile.h"
+#include "npyfile.h"
 
 
 typedef int int_fp_v (void);
@@ -45,26 +50,45 @@ typedef struct {
 
 struct options options;
 
+/* printed when a logreg model cannot be parsed */
+static char logreg_syntax_error_msg[] = "Syntax error: logreg expects a dataset handle, followed by a dependent variable name, followed by \" = \" (note the spaces), followed by one or more main effects and optional interaction effects.\nSpecify interactions with an asterisk, as in var1*var2\nSpecify direct effects by preceding with \"direct.\", as in direct.var1";
+
+/* temporaries of each logreg command, reset when the command ends */
+static arena scratch = {NULL};
+
 /* declarations for functions used to process commands */
 static int cmd_quit   (void);
 static int cmd_comment (void);
 static int cmd_import (void);
+static int cmd_save (void);
+static int cmd_load (void);
+static int cmd_importnpy (void);
 static int cmd_print (void);
 static int cmd_weight (void);
+static int cmd_pivot (void);
+static int cmd_drop (void);
 static int cmd_table (void);
 static int cmd_logreg (void);
+static int cmd_logregfile (void);
 static int cmd_option (void);
 static int cmd_help (void);
 
+static int fit_model (dataset *ds, char **fields, int nfields);
 static void eprintf (char *fmt, ...);
 
 /* structure of commands */
 COMMAND cmds[] = {
     {"import", cmd_import, "Import a delimited text file."},
+    {"save",   cmd_save,   "Save a dataset to a native binary file."},
+    {"load",   cmd_load,   "Load a dataset from a native binary file."},
+    {"importnpy", cmd_importnpy, "Map a NumPy .npy or raw float64 matrix file as a dataset."},
     {"print",  cmd_print,  "Print a dataset."},
-    {"table",  cmd_table,  "Univariate frequency tabulation."},
+    {"table",  cmd_table,  "Univariate frequency tabulation of one or more variables."},
     {"logreg", cmd_logreg, "Estimate a logistic regression model."},
+    {"logregfile", cmd_logregfile, "Estimate a model from a delimited text file without importing it."},
     {"weight", cmd_weight, "Assign a weight variable to the dataset."},
+    {"pivot",  cmd_pivot,  "Store a dataset by columns or by rows."},
+    {"drop",   cmd_drop,   "Delete datasets and release their memory."},
     {"option", cmd_option, "Set a global option."},
     {"help",   cmd_help,   "Print some help on command syntax."},
     {"q",      cmd_quit,   "Exit the program."},
@@ -180,15 +204,78 @@ static int cmd_import (void) {
     char *handle;
     char *filename;
     int retval;
+    int i;
+    int bad = 0;
+    char *end;
+    import_spec spec;
 
     printlog(VERBOSE, "%s\n", "Entering 'cmd_import'");
 
     /* warn and return if we do not have the required number of arguments */
-    if (csvnfield() != 4) {
-        printlog(INFO, "%s\n", "Syntax error: import expects 3 arguments:  handle filename delimiter");
+    if (csvnfield() < 4) {
+        printlog(INFO, "%s\n", "Syntax error: import expects 3 arguments:  handle filename delimiter [mmap] [collapse] [keep=var1,var2,...] [compact[=var:type,...]] [encode] [columns] [sample=fraction|sample=reservoir:count] [limit=count]");
         return 0;
     }
 
+    /* any remaining arguments are modifiers to the import */
+    init_import_spec(&spec);
+    for (i = 4; i < csvnfield(); i++) {
+        if (csvfield(i)[0] == '\0') {
+            /* an empty field from trailing or repeated spaces */
+            continue;
+        }
+        else if (strcmp(csvfield(i), "mmap") == 0) {
+            spec.use_mmap = 1;
+        }
+        else if (strcmp(csvfield(i), "collapse") == 0) {
+            spec.collapse = 1;
+        }
+        else if (strncmp(csvfield(i), "keep=", 5) == 0) {
+            free(spec.keep);
+            spec.keep = estrdup(csvfield(i) + 5);
+        }
+        else if (strcmp(csvfield(i), "compact") == 0) {
+            spec.compact = 1;
+        }
+        else if (strncmp(csvfield(i), "compact=", 8) == 0) {
+            spec.compact = 1;
+            free(spec.coltypes);
+            spec.coltypes = estrdup(csvfield(i) + 8);
+        }
+        else if (strcmp(csvfield(i), "encode") == 0) {
+            spec.encode = 1;
+        }
+        else if (strcmp(csvfield(i), "columns") == 0) {
+            spec.columns = 1;
+        }
+        else if (strncmp(csvfield(i), "sample=reservoir:", 17) == 0) {
+            spec.reservoir = strtol(csvfield(i) + 17, &end, 10);
+            bad = (*end != '\0' || spec.reservoir < 1);
+        }
+        else if (strncmp(csvfield(i), "sample=", 7) == 0) {
+            spec.sample = strtod(csvfield(i) + 7, &end);
+            bad = (*end != '\0' || !(spec.sample > 0 && spec.sample <= 1));
+        }
+        else if (strncmp(csvfield(i), "limit=", 6) == 0) {
+            spec.limit = strtol(csvfield(i) + 6, &end, 10);
+            bad = (*end != '\0' || spec.limit < 1);
+        }
+        else {
+            printlog(INFO, "%s%s\n", "Syntax error: unrecognized import modifier: ", csvfield(i));
+            free(spec.keep);
+            free(spec.coltypes);
+            return 0;
+        }
+
+        if (bad) {
+            printlog(INFO, "%s%s%s\n", "Syntax error: invalid import modifier: ", csvfield(i),
+                ".  Expected sample=fraction, sample=reservoir:count or limit=count.");
+            free(spec.keep);
+            free(spec.coltypes);
+            return 0;
+        }
+    }
+
     printlog(VERBOSE, "%s%s\n%s%s\n%s%s\n", "Arguments to import:\nHandle: ", csvfield(1),
         "Filename: ", csvfield(2), "Delimiter: ", csvfield(3));
 
@@ -211,12 +298,92 @@ static int cmd_import (void) {
             printlog(VERBOSE, "%s%c\n", "Parsed delimiter: ", delim);
     }
 
-    retval = import_dataset(handle, filename, delim);
+    retval = import_dataset(handle, filename, delim, &spec);
 
     printlog(VERBOSE, "%s%d\n", "Return value from import_dataset: ", retval);
 
     free(handle);
     free(filename);
+    free(spec.keep);
+    free(spec.coltypes);
+
+    return 0;
+}
+
+
+static int cmd_save (void) {
+
+    dataset *ds;
+
+    printlog(VERBOSE, "%s\n", "Entering 'cmd_save'");
+
+    /* warn and return if we do not have the required number of arguments */
+    if (csvnfield() != 3) {
+        printlog(INFO, "%s\n", "Syntax error: save expects 2 arguments:  handle filename");
+        return 0;
+    }
+
+    printlog(VERBOSE, "%s%s%s%s\n", "Arguments to save:\nHandle: ", csvfield(1), "\nFilename: ", csvfield(2));
+
+    if ((ds = find_dataset(csvfield(1))) == NULL) {
+        printlog(INFO, "%s%s\n", "Error:  dataset not found: ", csvfield(1));
+        return 0;
+    }
+
+    save_dataset(ds, csvfield(2));
+
+    return 0;
+}
+
+
+static int cmd_load (void) {
+
+    char *handle;
+    char *filename;
+    int retval;
+
+    printlog(VERBOSE, "%s\n", "Entering 'cmd_load'");
+
+    /* warn and return if we do not have the required number of arguments */
+    if (csvnfield() != 3) {
+        printlog(INFO, "%s\n", "Syntax error: load expects 2 arguments:  handle filename");
+        return 0;
+    }
+
+    printlog(VERBOSE, "%s%s%s%s\n", "Arguments to load:\nHandle: ", csvfield(1), "\nFilename: ", csvfield(2));
+
+    handle = estrdup(csvfield(1));
+    filename = estrdup(csvfield(2));
+
+    retval = load_dataset(handle, filename);
+
+    printlog(VERBOSE, "%s%d\n", "Return value from load_dataset: ", retval);
+
+    free(handle);
+    free(filename);
+
+    return 0;
+}
+
+
+static int cmd_importnpy (void) {
+
+    int retval;
+
+    printlog(VERBOSE, "%s\n", "Entering 'cmd_importnpy'");
+
+    /* warn and return if we do not have the required number of arguments */
+    if (csvnfield() != 4 || csvfield(3)[0] == '\0') {
+        printlog(INFO, "%s\n", "Syntax error: importnpy expects 3 arguments:  handle filename var1,var2,...");
+        return 0;
+    }
+
+    printlog(VERBOSE, "%s%s%s%s%s%s\n", "Arguments to importnpy:\nHandle: ", csvfield(1), "\nFilename: ",
+        csvfield(2), "\nNames: ", csvfield(3));
+
+    retval = load_npy(csvfield(1), csvfield(2), csvfield(3));
+
+    printlog(VERBOSE, "%s%d\n", "Return value from load_npy: ", retval);
 
     return 0;
 }
@@ -298,44 +465,111 @@ static int cmd_weight (void) {
 }
 
 
+static int cmd_pivot (void) {
+
+    dataset *ds;
+    int columns = 1;
+
+    printlog(VERBOSE, "%s\n", "Entering 'cmd_pivot'");
+
+    /* warn and return if we do not have the required number of arguments */
+    if (csvnfield() < 2 || csvnfield() > 3
+        || (csvnfield() == 3 && strcmp(csvfield(2), "columns") != 0 && strcmp(csvfield(2), "rows") != 0)) {
+        printlog(INFO, "%s\n", "Syntax error: pivot expects 1 or 2 arguments:  handle [columns|rows]");
+        return 0;
+    }
+    if (csvnfield() == 3 && strcmp(csvfield(2), "rows") == 0) {
+        columns = 0;
+    }
+
+    printlog(VERBOSE, "%s%s%s%s\n", "Arguments to pivot:\nHandle: ", csvfield(1), "\nLayout: ",
+        (columns) ? "columns" : "rows");
+
+    if ((ds = find_dataset(csvfield(1))) == NULL) {
+        printlog(INFO, "%s%s\n", "Error:  dataset not found: ", csvfield(1));
+        return 0;
+    }
+
+    pivot_dataset(ds, columns);
+
+    return 0;
+}
+
+
+static int cmd_drop (void) {
+
+    int i;
+
+    printlog(VERBOSE, "%s\n", "Entering 'cmd_drop'");
+
+    /* warn and return if we do not have the required number of arguments */
+    if (csvnfield() < 2) {
+        printlog(INFO, "%s\n", "Syntax error: drop expects at least 1 argument:  handle [handle ...]");
+        return 0;
+    }
+
+    for (i = 1; i < csvnfield(); i++) {
+        if (csvfield(i)[0] != '\0' && drop_dataset(csvfield(i)) < 0) {
+            printlog(INFO, "%s%s\n", "Error:  dataset not found: ", csvfield(i));
+        }
+    }
+
+    return 0;
+}
+
+
 static int cmd_table (void) {
 
     char *handle, *varname;
     dataset *ds;
-    int var;
+    int *vars;
+    int i, nvars;
 
     printlog(VERBOSE, "%s\n", "Entering 'cmd_table'");
 
     /* warn and return if we do not have the required number of arguments */
-    if (csvnfield() != 3) {
-        printlog(INFO, "%s\n", "Syntax error: table expects 2 arguments:  handle varname");
+    if (csvnfield() < 3) {
+        printlog(INFO, "%s\n", "Syntax error: table expects at least 2 arguments:  handle varname [varname ...]");
+        return 0;
     }
 
     handle = estrdup(csvfield(1));
-    varname = estrdup(csvfield(2));
 
-    printlog(VERBOSE, "%s%s%s%s\n", "Arguments to table:\nHandle: ", handle, "\nVariable: ", varname);
+    printlog(VERBOSE, "%s%s\n", "Arguments to table:\nHandle: ", handle);
 
     ds = find_dataset(handle);
 
     if (ds == NULL) {
         printlog(INFO, "%s%s\n", "Error:  dataset not found: ", handle);
         free(handle);
-        free(varname);
         return 0;
     }
 
-    var = find_varname(ds, varname);
+    /* all of the variables are tabulated together, so none are if any is missing */
+    vars = (int *) emalloc((csvnfield() - 2) * sizeof(int));
+    for (i = 2, nvars = 0; i < csvnfield(); i++) {
+        varname = csvfield(i);
+        if (varname[0] == '\0') {
+            continue;
+        }
+        printlog(VERBOSE, "%s%s\n", "Variable: ", varname);
+        vars[nvars] = find_varname(ds, varname);
+        if (vars[nvars] == -1) {
+            printlog(INFO, "%s%s\n", "Error:  variable not found: ", varname);
+            break;
+        }
+        nvars++;
+    }
 
-    if (var == -1) {
-        printlog(INFO, "%s%s\n", "Error:  variable not found: ", varname);
+    if (i == csvnfield() && nvars == 0) {
+        printlog(INFO, "%s\n", "Syntax error: table expects at least 2 arguments:  handle varname [varname ...]");
     }
-    else {
-        frequency_table(ds, var);
+    else if (i == csvnfield()) {
+        frequency_table(ds, vars, nvars);
     }
 
     free(handle);
-    free(varname);
+    free(vars);
 
     return 0;
 }
@@ -344,12 +578,8 @@ static int cmd_table (void) {
 static int cmd_logreg (void) {
 
     dataset *ds;
-    model   *mod;
-    char    syntax_error_msg[] = "Syntax error: logreg expects a dataset handle, followed by a dependent variable name, followed by \" = \" (note the spaces), followed by one or more main effects and optional interaction effects.\nSpecify interactions with an asterisk, as in var1*var2\nSpecify direct effects by preceding with \"direct.\", as in direct.var1";
+    char    **fields;
     int     i;
-    char    *varname;
-    char    *endvar;
-    int     retval = 0;
 
     printlog(VERBOSE, "%s\n", "Entering 'cmd_logreg'");
 
@@ -364,7 +594,7 @@ static int cmd_logreg (void) {
 
     /* primary syntax check:  require a variable name followed by "=" followed by at least one variable */
     if (csvnfield() < 5 || strcmp("=", csvfield(3)) != 0) {
-        printlog(INFO, "%s\n", syntax_error_msg);
+        printlog(INFO, "%s\n", logreg_syntax_error_msg);
         return 0;
     }
 
@@ -375,29 +605,147 @@ static int cmd_logreg (void) {
     }
     printlog(VERBOSE, "%s%s\n", "Dataset found with handle: ", ds->handle);
 
+    /* the model starts with the dependent variable */
+    fields = (char **) emalloc(csvnfield() * sizeof(char *));
+    for (i = 2; i < csvnfield(); i++) {
+        fields[i - 2] = csvfield(i);
+    }
+    fit_model(ds, fields, csvnfield() - 2);
+    free(fields);
+
+    return 0;
+}
+
+
+static int cmd_logregfile (void) {
+
+    /***
+        Estimate a model straight from a delimited text file, without
+        keeping the file as a dataset.
+
+        Only the model variables are read, and rows are collapsed to the
+        distinct combinations of their values as the file is parsed, so
+        memory grows with the number of cells in the crosstab rather than
+        with the number of rows.  The collapsed rows are weighted by their
+        counts, which gives the same estimates as a full import.
+    ***/
+
+    import_spec spec;
+    char    syntax_error_msg[] = "Syntax error: logregfile expects a filename and delimiter, followed by a model as for logreg:  filename delimiter dv = iv1 iv2 ...";
+    char    **fields;
+    char    *filename;
+    char    *keep, *varname, *endvar;
+    char    delim;
+    int     nfields;
+    int     i;
+    size_t  len;
+
+    printlog(VERBOSE, "%s\n", "Entering 'cmd_logregfile'");
+
+    if (csvnfield() < 6 || strcmp("=", csvfield(4)) != 0) {
+        printlog(INFO, "%s\n", syntax_error_msg);
+        return 0;
+    }
+
+    /* make copies of the arguments because the import will overwrite them */
+    filename = estrdup(csvfield(1));
+    delim = (strncmp(csvfield(2), "\\t", 2) == 0) ? '\t' : csvfield(2)[0];
+    nfields = csvnfield() - 3;
+    fields = (char **) emalloc(nfields * sizeof(char *));
+    for (i = 0; i < nfields; i++) {
+        fields[i] = estrdup(csvfield(i + 3));
+    }
+
+    /* keep the dependent variable and every variable named in an effect */
+    for (i = len = 0; i < nfields; i++) {
+        len += strlen(fields[i]) + 1;
+    }
+    keep = (char *) emalloc(len + 1);
+    keep[0] = '\0';
+    for (i = 0; i < nfields; i++) {
+        if (i == 1) {
+            continue;
+        }
+        varname = fields[i];
+        if (strncmp("direct.", varname, 7) == 0) {
+            varname += 7;
+        }
+        if (keep[0] != '\0') {
+            strcat(keep, ",");
+        }
+        strcat(keep, varname);
+    }
+    for (endvar = keep; (endvar = strchr(endvar, '*')) != NULL; ) {
+        *endvar = ',';
+    }
+
+    init_import_spec(&spec);
+    spec.collapse = 1;
+    spec.keep = keep;
+    spec.is_public = 0;
+
+    if (import_dataset("_logregfile", filename, delim, &spec) == 0) {
+        fit_model(spec.ds, fields, nfields);
+    }
+
+    if (spec.ds != NULL) {
+        for (i = 0; i < spec.ds->nvars; i++) {
+            free(spec.ds->varnames[i]);
+        }
+        free(spec.ds->varnames);
+        free_dataset(spec.ds);
+    }
+    for (i = 0; i < nfields; i++) {
+        free(fields[i]);
+    }
+    free(fields);
+    free(keep);
+    free(filename);
+
+    return 0;
+}
+
+
+static int fit_model (dataset *ds, char **fields, int nfields) {
+
+    /***
+        Build a model from the fields of a logreg command and estimate it.
+
+        Expected:
+        fields[0] == dependent variable name
+        fields[1] == "="
+        fields[2] == start of main effects
+    ***/
+
+    model   *mod;
+    int     i;
+    char    *varname;
+    char    *endvar;
+    int     retval = 0;
+
     mod = (model *) emalloc(sizeof(model));
     init_model(mod);
 
     /* add the dependent variable to the model */
-    if (add_model_variable(mod, ds, csvfield(2), DEPENDENT) != 0) {
-        printlog(INFO, "%s%s%s%s\n", "Dependent variable name not found: ", csvfield(2), " in dataset: ", ds->handle);
+    if (add_model_variable(mod, ds, fields[0], DEPENDENT) != 0) {
+        printlog(INFO, "%s%s%s%s\n", "Dependent variable name not found: ", fields[0], " in dataset: ", ds->handle);
         delete_model(mod);
-        return 0;
+        return -1;
     }
 
     /* parse the independent variable effects */
-    for (i = 4; i < csvnfield(); i++) {
+    for (i = 2; i < nfields; i++) {
 
         /* is this an interaction? */
-        if (strchr(csvfield(i), '*') != NULL) {
+        if (strchr(fields[i], '*') != NULL) {
 
-            varname = csvfield(i);
+            varname = fields[i];
             endvar = varname;
 
             while (varname != NULL) {
                 endvar = strchr(varname, '*');
                 if (endvar != NULL) endvar[0] = '\0';
-                if (strcmp(varname, csvfield(i)) == 0) {
+                if (strcmp(varname, fields[i]) == 0) {
                     retval = add_model_variable(mod, ds, varname, NEW_INTERACTION);
                 }
                 else {
@@ -415,22 +763,22 @@ static int cmd_logreg (void) {
         }
 
         /* is this a direct effect? */
-        else if (strlen(csvfield(i)) >= 8 && strncmp("direct.", csvfield(i), 7) == 0) {
-            varname = csvfield(i) + 7;
+        else if (strlen(fields[i]) >= 8 && strncmp("direct.", fields[i], 7) == 0) {
+            varname = fields[i] + 7;
             retval = add_model_variable(mod, ds, varname, DIRECT);
         }
 
         /* otherwise this is a categorical main effect */
         else {
-            varname = csvfield(i);
+            varname = fields[i];
             retval = add_model_variable(mod, ds, varname, MAIN);
         }
 
         /* error check */
         if (retval != 0) {
-            printlog(INFO, "%s\n", syntax_error_msg);
+            printlog(INFO, "%s\n", logreg_syntax_error_msg);
             delete_model(mod);
-            return 0;
+            return -1;
         }
 
     }   /* end parsing independent variables */
@@ -445,11 +793,15 @@ static int cmd_logreg (void) {
         struct can now be handed off to the mlelr function where the real
         work happens.
     ***/
-    retval = mlelr(ds, mod);
+    retval = mlelr(ds, mod, &scratch);
 
     printlog(VERBOSE, "Return value from mlelr function: %d\n", retval);
 
-    return 0;
+    /* every temporary of the estimation goes at once, and the space is kept for the next model */
+    reset_arena(&scratch);
+    delete_model(mod);
+
+    return retval;
 }
 
 
@@ -503,6 +855,10 @@ void init_options (void) {
     options.v = (char **) emalloc(options.size * sizeof(char *));
 
     set_option("params", "centerpoint");
+    set_option("threads", "1");
+    set_option("seed", "1");
+    set_option("rowindex", "0");
+    set_option("memlimit", "0");
 
 
 }
@@ -590,6 +946,19 @@ void printout (char *format, ...) {
 
 
 
+double seconds_now (void) {
+
+    /* monotonic wall clock time in seconds, for timing long operations */
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+
+}
+
+
+
+
 /***
 
     Wrappers for memory allocation.
@@ -51,6 +51,7 @@ extern void init_options (void);
 
 extern void printlog (int loglevel, char *format, ...);
 extern void printout (char *format, ...);
+extern double seconds_now (void);
 
 /* safe allocation of memory, see Kernighan & Pike */
 extern void *emalloc (size_t n);
@@ -29,6 +29,7 @@ Copyright (C) 2015 Scott A. Czepiel
 #include <gsl/gsl_linalg.h>
 #include <gsl/gsl_cdf.h>
 #include "dataset.h"
+#include "arena.h"
 #include "model.h"
 #include "mlelr.h"
 #include "interface.h"
@@ -37,9 +38,19 @@ Copyright (C) 2015 Scott A. Czepiel
 static const int MAX_ITER = 30;
 static const double EPSILON = 1e-8;
 
+/* space newton_raphson works in, allocated once per model rather than once per iteration */
+typedef struct {
+    double **pi;    /* predicted probabilities, N rows by J cols */
+    double  *numer; /* numerators of pi for one population, J */
+    double  *g;     /* gradient vector: first derivative of ll */
+    double **H;     /* Hessian matrix: second derivative of ll */
+} nr_work;
+
 static int cholesky(double **x, int order);
 static int backsub(double **x, int order);
 static int trimult(double **in, double **out, int order);
+static int find_freq_row(double **freq, int levels, double target);
+static double **new_matrix(arena *scratch, int rows, int cols);
 
 static int newton_raphson (
     double **X,     /* design matrix, N rows by K cols */
@@ -52,11 +63,17 @@ static int newton_raphson (
     double  *beta1, /* parameters after this iteration */
     double **xtwx,
     double  *loglike,
-    double  *deviance  );
+    double  *deviance,
+    nr_work *work  );
 
 
 
-int mlelr (dataset *ds, model *mod) {
+int mlelr (dataset *ds, model *mod, arena *scratch) {
+
+    /***
+        Estimate mod from ds.  Every temporary comes from scratch, which
+        the caller resets once the results are printed.
+    ***/
 
     int i, j, k, q;
     int popchange;
@@ -66,6 +83,7 @@ int mlelr (dataset *ds, model *mod) {
     int xtabcols;
     double **xtab;
     int levels;
+    int level;
     double **freq;
     int *intcolidx;
     double tgt;
@@ -91,6 +109,7 @@ int mlelr (dataset *ds, model *mod) {
     double  *loglike, loglike0;
     double  *deviance;
 
+    nr_work work;
     int iter;
     int convergence;
     int nrret;
@@ -122,7 +141,7 @@ int mlelr (dataset *ds, model *mod) {
         for each row in the xtab.
     ***/
 
-    popindex = (int *) emalloc(xtabrows * sizeof(int));
+    popindex = (int *) arena_alloc(scratch, xtabrows * sizeof(int));
 
     /* set the population index for the first row */
     N = 1;
@@ -191,13 +210,11 @@ int mlelr (dataset *ds, model *mod) {
     ***/
 
 
-    X = (double **) emalloc(N * sizeof(double *));
-    Y = (double **) emalloc(N * sizeof(double *));
-    n = (double *)  emalloc(N * sizeof(double));
+    X = new_matrix(scratch, N, K);
+    Y = new_matrix(scratch, N, J);
+    n = (double *)  arena_alloc(scratch, N * sizeof(double));
 
     for (i = 0; i < N; i++) {
-        X[i] = (double *) emalloc(K * sizeof(double));
-        Y[i] = (double *) emalloc(J * sizeof(double));
         /* initialize n and Y to 0 */
         n[i] = 0;
         for (j = 0; j < J; j++) {
@@ -205,8 +222,8 @@ int mlelr (dataset *ds, model *mod) {
         }
     }
 
-    startcol = (int *) emalloc(mod->numiv * sizeof(int));
-    colspan = (int *) emalloc(mod->numiv * sizeof(int));
+    startcol = (int *) arena_alloc(scratch, mod->numiv * sizeof(int));
+    colspan = (int *) arena_alloc(scratch, mod->numiv * sizeof(int));
 
     /* column index of each term in an interaction
        initialize to hold the maximum number of interaction terms */
@@ -216,12 +233,12 @@ int mlelr (dataset *ds, model *mod) {
             if (mod->inttc[i] > j)
                 j = mod->inttc[i];
         }
-        intcolidx = (int *) emalloc(j * sizeof(int));
+        intcolidx = (int *) arena_alloc(scratch, j * sizeof(int));
     }
     else
         intcolidx = NULL;
 
-    Xlabels = (char **) emalloc(K * sizeof(char *));
+    Xlabels = (char **) arena_alloc(scratch, K * sizeof(char *));
 
     /***
         Step 5.  Build X, Y, and n
@@ -259,16 +276,16 @@ int mlelr (dataset *ds, model *mod) {
                 /* otherwise, use full-rank center-point parameterization */
                 else {
 
-                    /* do for each X column for this variable */
+                    /* find the level once, then do for each X column for this variable */
                     levels = mod->freqs[j]->n;
+                    freq = mod->freqs[j]->obs;
+                    level = find_freq_row(freq, levels, xtab[i][j]);
 
                     for (k = 0; k < levels - 1; k++) {
 
-                        freq = mod->freqs[j]->obs;
-
-                        if (xtab[i][j] == freq[k][0])
+                        if (level == k)
                             X[xr][xc] = 1;
-                        else if (!dummy && xtab[i][j] == freq[levels - 1][0])
+                        else if (!dummy && level == levels - 1)
                             X[xr][xc] = -1;
                         else
                             X[xr][xc] = 0;
@@ -281,22 +298,24 @@ int mlelr (dataset *ds, model *mod) {
 
         } /* end if new pop */
 
+        lastpop = xr;
+
+        /* a response with no level, such as a NaN, has no column in Y, so the row is left out */
+        j = find_freq_row(mod->freqs[mod->numiv]->obs, J, xtab[i][xtabcols - 2]);
+        if (j < 0)
+            continue;
+
         /* add count of Y-value to appropriate population */
-        for (j = 0; j < J; j++) {
-            if (xtab[i][xtabcols - 2] == mod->freqs[mod->numiv]->obs[j][0])
-                break;
-        }
         Y[xr][j] = xtab[i][xtabcols - 1];
 
         /* increment N */
         n[xr] += Y[xr][j];
-        lastpop = xr;
 
     } /* end loop for each row in xtab */
 
 
     /* build labels for each parameter in the design matrix */
-    Xlabels[0] = estrdup("Intercept");
+    Xlabels[0] = arena_strdup(scratch, "Intercept");
     for (i = 0, k = 1; i < mod->numiv; i++) {
         if (mod->direct[i]) {
             Xlabels[k] = mod->ivnames[i];
@@ -383,25 +402,28 @@ int mlelr (dataset *ds, model *mod) {
 
 
     /* allocate space for beta arrays and covariance matrix */
-    beta =     (double *) emalloc(K * (J - 1) * sizeof(double));
-    beta0 =    (double *) emalloc(K * (J - 1) * sizeof(double));
-    beta_inf = (double *) emalloc(K * (J - 1) * sizeof(double));
+    beta =     (double *) arena_alloc(scratch, K * (J - 1) * sizeof(double));
+    beta0 =    (double *) arena_alloc(scratch, K * (J - 1) * sizeof(double));
+    beta_inf = (double *) arena_alloc(scratch, K * (J - 1) * sizeof(double));
 
-    xtwx = (double **) emalloc(K * (J - 1) * sizeof(double *));
-    for (i = 0; i < K * (J - 1); i++) {
-        xtwx[i] = (double *) emalloc(K * (J - 1) * sizeof(double));
-    }
+    xtwx = new_matrix(scratch, K * (J - 1), K * (J - 1));
 
     /* allocate same amount of space for sigprms */
-    sigprms = (double *) emalloc(K * (J - 1) * sizeof(double));
-    stderrs = (double *) emalloc(K * (J - 1) * sizeof(double));
-    wald =    (double *) emalloc(K * (J - 1) * sizeof(double));
+    sigprms = (double *) arena_alloc(scratch, K * (J - 1) * sizeof(double));
+    stderrs = (double *) arena_alloc(scratch, K * (J - 1) * sizeof(double));
+    wald =    (double *) arena_alloc(scratch, K * (J - 1) * sizeof(double));
 
     /* pointer to pass as arg to n-r to store log likelihood of new iteration */
-    loglike = (double *) emalloc(sizeof(double));
+    loglike = (double *) arena_alloc(scratch, sizeof(double));
 
     /* pointer to pass as arg to n-r to store deviance of new iteration */
-    deviance = (double *) emalloc(sizeof(double));
+    deviance = (double *) arena_alloc(scratch, sizeof(double));
+
+    /* work space for every iteration */
+    work.pi = new_matrix(scratch, N, J);
+    work.numer = (double *) arena_alloc(scratch, J * sizeof(double));
+    work.g = (double *) arena_alloc(scratch, K * (J - 1) * sizeof(double));
+    work.H = new_matrix(scratch, K * (J - 1), K * (J - 1));
 
     /* initialize starting betas to 0 */
     for (i = 0; i < (K * (J - 1)); i++) {
@@ -421,7 +443,7 @@ int mlelr (dataset *ds, model *mod) {
         }
 
         /* run an iteration, exit if failure */
-        nrret = newton_raphson(X, Y, n, J, N, K, beta0, beta, xtwx, loglike, deviance);
+        nrret = newton_raphson(X, Y, n, J, N, K, beta0, beta, xtwx, loglike, deviance, &work);
 
         /* NOTE:  Backtracking code would go here, not currently implemented */
 
@@ -563,7 +585,8 @@ static int newton_raphson (
     double  *beta1, /* parameters after this iteration */
     double **xtwx,
     double  *loglike,
-    double  *deviance  ) {
+    double  *deviance,
+    nr_work *work  ) {
 
 
     /* local variable declarations */
@@ -580,22 +603,13 @@ static int newton_raphson (
     /* end local variable declarations */
 
 
-    /* setup and memory allocation */
+    /* setup, in space allocated by the caller */
     ret = -1;
 
-    pi = (double **) emalloc(N * sizeof(double *));
-    for (i = 0; i < N; i++) {
-        pi[i] = (double *) emalloc(J * sizeof(double));
-    }
-
-    numer = (double *) emalloc(J * sizeof(double));
-
-    g = (double *) emalloc((K * (J - 1)) * sizeof(double));
-    H = (double **) emalloc((K * (J - 1)) * sizeof(double *));
-
-    for (i = 0; i < (K * (J - 1)); i++) {
-        H[i] = (double *) emalloc((K * (J - 1)) * sizeof(double));
-    }
+    pi = work->pi;
+    numer = work->numer;
+    g = work->g;
+    H = work->H;
 
     /* initializations */
     for (i = 0; i < (K * (J - 1)); i++) {
@@ -709,17 +723,6 @@ static int newton_raphson (
         beta1[i] = sum1;
     }
 
-
-    /* free local memory */
-    free(numer);
-    free(g);
-    for (i = 0; i < N; i++)
-        free(pi[i]);
-    free(pi);
-    for (i = 0; i < K * (J - 1); i++)
-        free(H[i]);
-    free(H);
-
     return 0;
 }
 
@@ -792,3 +795,50 @@ static int trimult(double **in, double **out, int order) {
 
     return 0;
 }
+
+static int find_freq_row(double **freq, int levels, double target) {
+
+    /***
+        Return the row of the sorted frequency table freq whose value is
+        target, or -1 if there is none.  The rows are searched by halves,
+        and only if that misses, as it may when the table holds a NaN, one
+        by one.
+    ***/
+
+    int lo = 0;
+    int hi = levels - 1;
+    int mid;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (freq[mid][0] < target)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (levels > 0 && freq[lo][0] == target)
+        return lo;
+
+    for (lo = 0; lo < levels; lo++) {
+        if (freq[lo][0] == target)
+            return lo;
+    }
+
+    return -1;
+}
+
+static double **new_matrix(arena *scratch, int rows, int cols) {
+
+    /* allocate a rows by cols matrix from scratch, with its rows in one block */
+
+    double **m;
+    double *block;
+    int i;
+
+    m = (double **) arena_alloc(scratch, rows * sizeof(double *));
+    block = (double *) arena_alloc(scratch, (size_t) rows * cols * sizeof(double));
+    for (i = 0; i < rows; i++)
+        m[i] = &block[(size_t) i * cols];
+
+    return m;
+}
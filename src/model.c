@@ -25,28 +25,46 @@ Copyright (C) 2015 Scott A. Czepiel
 #include <stdlib.h>
 #include <string.h>
 #include "dataset.h"
+#include "arena.h"
 #include "model.h"
 #include "interface.h"
 
 
 void init_model (model *mod) {
 
+    init_arena(&mod->arena);
+    mod->dvname = NULL;
     mod->maxiv = 1;
     mod->numiv = 0;
-    mod->ivnames = (char **) emalloc(mod->maxiv * sizeof(char *));
-    mod->iv = (int *) emalloc(mod->maxiv * sizeof(int));
-    mod->direct = (int *) emalloc(mod->maxiv * sizeof(int));
+    mod->ivnames = (char **) arena_alloc(&mod->arena, mod->maxiv * sizeof(char *));
+    mod->iv = (int *) arena_alloc(&mod->arena, mod->maxiv * sizeof(int));
+    mod->direct = (int *) arena_alloc(&mod->arena, mod->maxiv * sizeof(int));
     mod->maxints = 1;
     mod->numints = 0;
-    mod->inttc = (int *) emalloc(mod->maxints * sizeof(int));
-    mod->ints = (int **) emalloc(mod->maxints * sizeof(int *));
-    mod->intnames = (char **) emalloc(mod->maxints * sizeof(char *));
+    mod->inttc = (int *) arena_alloc(&mod->arena, mod->maxints * sizeof(int));
+    mod->ints = (int **) arena_alloc(&mod->arena, mod->maxints * sizeof(int *));
+    mod->intnames = (char **) arena_alloc(&mod->arena, mod->maxints * sizeof(char *));
+    mod->xtab = NULL;
+    mod->freqs = NULL;
 
 }
 
 void delete_model (model *mod) {
-    /* This feature is currently unavailable. */
-    return;
+
+    /* release the model made by init_model on the heap, its tables and everything in its arena */
+    int i;
+
+    if (mod->xtab != NULL) {
+        free_dataset(mod->xtab);
+    }
+    if (mod->freqs != NULL) {
+        for (i = 0; i <= mod->numiv; i++) {
+            free_dataset(mod->freqs[i]);
+        }
+    }
+    free_arena(&mod->arena);
+    free(mod);
+
 }
 
 void print_model (model *mod) {
@@ -120,7 +138,7 @@ int add_model_variable (model *mod, dataset *ds, char *varname, int vartype) {
     /* add the DEPENDENT variable to the model */
     if (vartype == DEPENDENT) {
         mod->dv = varidx;
-        mod->dvname = estrdup(varname);
+        mod->dvname = arena_strdup(&mod->arena, varname);
         return 0;
     }
 
@@ -149,14 +167,14 @@ int add_model_variable (model *mod, dataset *ds, char *varname, int vartype) {
         /* space check */
         if (1 + mod->numiv > mod->maxiv) {
             mod->maxiv *= 2;
-            mod->ivnames = (char **) erealloc(mod->ivnames, mod->maxiv * sizeof(char *));
-            mod->iv = (int *) erealloc(mod->iv, mod->maxiv * sizeof(int));
-            mod->direct = (int *) erealloc(mod->direct, mod->maxiv * sizeof(int));
+            mod->ivnames = (char **) arena_grow(&mod->arena, mod->ivnames, mod->numiv * sizeof(char *), mod->maxiv * sizeof(char *));
+            mod->iv = (int *) arena_grow(&mod->arena, mod->iv, mod->numiv * sizeof(int), mod->maxiv * sizeof(int));
+            mod->direct = (int *) arena_grow(&mod->arena, mod->direct, mod->numiv * sizeof(int), mod->maxiv * sizeof(int));
         }
 
         /* add this variable as a main effect */
         mod->iv[mod->numiv] = varidx;
-        mod->ivnames[mod->numiv] = estrdup(varname);
+        mod->ivnames[mod->numiv] = arena_strdup(&mod->arena, varname);
         mod->direct[mod->numiv] = (vartype == DIRECT) ? 1 : 0;
         printlog(VERBOSE, "Setting direct array index %d to value %d\n", mod->numiv, mod->direct[mod->numiv]);
         mod->numiv++;
@@ -169,19 +187,20 @@ int add_model_variable (model *mod, dataset *ds, char *varname, int vartype) {
         /* space check */
         if (1 + mod->numints > mod->maxints) {
             mod->maxints *= 2;
-            mod->inttc = (int *) erealloc(mod->inttc, mod->maxints * sizeof(int));
-            mod->ints = (int **) erealloc(mod->ints, mod->maxints * sizeof(int *));
-            mod->intnames = (char **) erealloc(mod->intnames, mod->maxints * sizeof(char *));
+            mod->inttc = (int *) arena_grow(&mod->arena, mod->inttc, mod->numints * sizeof(int), mod->maxints * sizeof(int));
+            mod->ints = (int **) arena_grow(&mod->arena, mod->ints, mod->numints * sizeof(int *), mod->maxints * sizeof(int *));
+            mod->intnames = (char **) arena_grow(&mod->arena, mod->intnames, mod->numints * sizeof(char *),
+                mod->maxints * sizeof(char *));
         }
 
         /* add this variable to the newly created interaction */
-        mod->ints[mod->numints] = (int *) emalloc(1 * sizeof(int));
+        mod->ints[mod->numints] = (int *) arena_alloc(&mod->arena, 1 * sizeof(int));
 
         /* set the index of the interaction variable in the iv array (not the dataset) */
         mod->ints[mod->numints][0] = ividx;
 
         mod->inttc[mod->numints] = 1;
-        mod->intnames[mod->numints] = estrdup(varname);
+        mod->intnames[mod->numints] = arena_strdup(&mod->arena, varname);
         mod->numints++;
 
     }
@@ -204,13 +223,14 @@ int add_model_variable (model *mod, dataset *ds, char *varname, int vartype) {
         }
 
         /* add this variable to the latest interaction */
-        mod->ints[mod->numints-1] = (int *) erealloc(mod->ints[mod->numints-1], (1 + mod->inttc[mod->numints-1]) * sizeof(int));
+        mod->ints[mod->numints-1] = (int *) arena_grow(&mod->arena, mod->ints[mod->numints-1],
+            mod->inttc[mod->numints-1] * sizeof(int), (1 + mod->inttc[mod->numints-1]) * sizeof(int));
         mod->ints[mod->numints-1][mod->inttc[mod->numints-1]] = ividx;
-        intname = (char *) emalloc( strlen(mod->intnames[mod->numints-1]) + strlen(varname) + 2 );
+        intname = (char *) arena_alloc(&mod->arena, strlen(mod->intnames[mod->numints-1]) + strlen(varname) + 2 );
         strcpy(intname, mod->intnames[mod->numints-1]);
         strcat(intname, "*");
         strcat(intname, varname);
-        mod->intnames[mod->numints-1] = estrdup(intname);
+        mod->intnames[mod->numints-1] = intname;
         mod->inttc[mod->numints-1] += 1;
 
     }
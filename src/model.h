@@ -27,7 +27,9 @@ Copyright (C) 2015 Scott A. Czepiel
 /***
     model
 
-    Store all relevant variables necessary to specify a model.
+    Store all relevant variables necessary to specify a model.  Everything
+    a model allocates comes from its arena, apart from the datasets xtab
+    and freqs, and delete_model releases all of it.
 ***/
 typedef struct {
     char    *dvname;   /* name of the dependent variable */
@@ -46,6 +48,8 @@ typedef struct {
     dataset *xtab;      /* cross-tabulation of all model variables */
     dataset **freqs;    /* array of frequency tables for all model variables */
 
+    arena   arena;      /* owner of the arrays and names above */
+
 } model;
 
 enum model_variable {
@@ -0,0 +1,284 @@
+/* npyfile.c */
+
+/*
+
+Copyright (C) 2015 Scott A. Czepiel
+
+    This file is part of mlelr.
+
+    mlelr is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    mlelr is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with mlelr.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "dataset.h"
+#include "interface.h"
+#include "npyfile.h"
+
+static int parse_npy_header (const char *map, size_t size, long long *offset, long long *rows, long long *cols);
+static const char *npy_value (const char *dict, const char *key);
+static char **split_names (char *names, int *nvars);
+
+
+int load_npy (char *handle, char *filename, char *names) {
+
+    /***
+        Add a dataset whose rows are those of the matrix in filename, named
+        by the comma-separated list names.
+
+        The file is mapped privately, and the dataset points straight into
+        the mapping, which it keeps until it is freed.  Rows added later go
+        into blocks of their own, as usual, and writing to a mapped row
+        changes only this process's copy of the page.
+    ***/
+
+    int fd;
+    struct stat st;
+    char *map;
+    char **varnames;
+    long long offset, rows, cols;
+    dataset *ds;
+    int nvars, j;
+    int npy;
+    double start;
+
+    printlog(INFO, "%s%s\n", "Loading matrix from file: ", filename);
+    start = seconds_now();
+
+    varnames = split_names(names, &nvars);
+
+    if (nvars < 1) {
+        printlog(INFO, "%s%s\n", "Error:  No column names given for file: ", filename);
+        free(varnames);
+        return -1;
+    }
+
+    if ((fd = open(filename, O_RDONLY)) < 0 || fstat(fd, &st) < 0) {
+        printlog(INFO, "%s%s\n", "Error:  Could not open file: ", filename);
+        if (fd >= 0) {
+            close(fd);
+        }
+        for (j = 0; j < nvars; j++) {
+            free(varnames[j]);
+        }
+        free(varnames);
+        return -1;
+    }
+
+    map = MAP_FAILED;
+    if (st.st_size > 0) {
+        map = (char *) mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+
+    if (st.st_size == 0) {
+        printlog(INFO, "%s%s\n", "Error:  Empty or truncated .npy file: ", filename);
+        rows = -1;
+    }
+    else if (map == MAP_FAILED) {
+        printlog(INFO, "%s%s\n", "Error:  Could not map file: ", filename);
+        rows = -1;
+    }
+    else if ((npy = (st.st_size >= NPY_MAGIC_LEN && memcmp(map, NPY_MAGIC, NPY_MAGIC_LEN) == 0))) {
+        if ((j = parse_npy_header(map, st.st_size, &offset, &rows, &cols)) == -2) {
+            printlog(INFO, "%s%s\n", "Error:  Empty or truncated .npy file: ", filename);
+            rows = -1;
+        }
+        else if (j < 0) {
+            printlog(INFO, "%s%s\n", "Error:  Not a C-order float64 .npy file of 1 or 2 dimensions: ", filename);
+            rows = -1;
+        }
+        else if (cols != nvars) {
+            printlog(INFO, "%s%lld%s%d%s\n", "Error:  The matrix has ", cols, " columns but ", nvars,
+                " names were given.");
+            rows = -1;
+        }
+    }
+    else {
+        /* raw doubles, with the names for a header */
+        offset = 0;
+        cols = nvars;
+        rows = st.st_size / (nvars * sizeof(double));
+        if ((long long) st.st_size != rows * nvars * (long long) sizeof(double)) {
+            printlog(INFO, "%s%s%s%d%s\n", "Error:  The size of raw matrix file ", filename,
+                " is not a multiple of ", nvars, " doubles.");
+            rows = -1;
+        }
+    }
+
+    if (rows > 0x7fffffff) {
+        printlog(INFO, "%s%s\n", "Error:  Too many rows in file: ", filename);
+        rows = -1;
+    }
+
+    if (rows < 0) {
+        if (map != MAP_FAILED) {
+            munmap(map, st.st_size);
+        }
+        for (j = 0; j < nvars; j++) {
+            free(varnames[j]);
+        }
+        free(varnames);
+        return -1;
+    }
+
+    madvise(map, st.st_size, MADV_SEQUENTIAL | MADV_WILLNEED);
+
+    ds = add_dataset(handle, nvars, varnames, 1);
+
+    /* the rows are used in place unless the data is not aligned for doubles */
+    if (offset % sizeof(double) == 0) {
+        attach_observations(ds, (double *) (map + offset), rows, map, st.st_size);
+    }
+    else {
+        printlog(VERBOSE, "%s\n", "Matrix data is not aligned, so it is copied");
+        add_observations(ds, (double *) (map + offset), rows);
+        munmap(map, st.st_size);
+    }
+
+    printlog(INFO, "%s%d%s%d%s\n", "Number of observations loaded: ", ds->n, " of ", ds->nvars, " variables.");
+    printlog(INFO, "Mapped %lld bytes in %.3f seconds\n", (long long) st.st_size, seconds_now() - start);
+
+    return 0;
+}
+
+
+
+
+/* static function definitions */
+
+static int parse_npy_header (const char *map, size_t size, long long *offset, long long *rows, long long *cols) {
+
+    /***
+        Read the header of a .npy file, which after the magic string and
+        version holds a Python dict literal such as:
+
+            {'descr': '<f8', 'fortran_order': False, 'shape': (1000, 5), }
+
+        Return -1 unless the array is of doubles in this host's byte order,
+        in C order, with 1 or 2 dimensions, and -2 if the file ends before
+        the header or the data it describes.
+    ***/
+
+    const unsigned char *u = (const unsigned char *) map;
+    const char *v;
+    char *dict;
+    char *end;
+    long long headerlen;
+    const char *descr;
+    int ok;
+    union { uint16_t i; char c[2]; } host = { 0x0102 };
+
+    /* version 1 has a 2 byte header length, versions 2 and 3 a 4 byte one, both little-endian */
+    if (size < 10) {
+        return -2;
+    }
+    if (u[6] == 1) {
+        headerlen = u[8] | (u[9] << 8);
+        *offset = 10 + headerlen;
+    }
+    else if ((u[6] == 2 || u[6] == 3) && size < 12) {
+        return -2;
+    }
+    else if (u[6] == 2 || u[6] == 3) {
+        headerlen = u[8] | (u[9] << 8) | (u[10] << 16) | ((long long) u[11] << 24);
+        *offset = 12 + headerlen;
+    }
+    else {
+        return -1;
+    }
+    if (*offset > (long long) size) {
+        return -2;
+    }
+
+    dict = (char *) emalloc(headerlen + 1);
+    memcpy(dict, map + *offset - headerlen, headerlen);
+    dict[headerlen] = '\0';
+
+    descr = (host.c[0] == 0x02) ? "'<f8'" : "'>f8'";
+    ok = (v = npy_value(dict, "descr")) != NULL && strncmp(v, descr, 5) == 0
+        && (v = npy_value(dict, "fortran_order")) != NULL && strncmp(v, "False", 5) == 0
+        && (v = npy_value(dict, "shape")) != NULL && *v == '(';
+
+    /* the shape is (rows,) or (rows, cols) */
+    if (ok) {
+        *rows = strtoll(v + 1, &end, 10);
+        ok = end > v + 1 && *end == ',' && *rows >= 0;
+        *cols = 1;
+        for (v = end + 1; *v == ' '; v++);
+        if (ok && *v != ')') {
+            *cols = strtoll(v, &end, 10);
+            for (ok = end > v && *cols > 0; *end == ' ' || *end == ','; end++);
+            ok = ok && *end == ')';
+        }
+    }
+    free(dict);
+
+    if (!ok) {
+        return -1;
+    }
+    if (*rows > ((long long) size - *offset) / (long long) sizeof(double) / *cols) {
+        return -2;
+    }
+
+    return 0;
+}
+
+
+static const char *npy_value (const char *dict, const char *key) {
+
+    /* return the start of the value of 'key' in a .npy header dict, or NULL */
+
+    const char *p;
+    size_t len = strlen(key);
+
+    for (p = dict; (p = strchr(p, '\'')) != NULL; p++) {
+        if (strncmp(p + 1, key, len) == 0 && p[len + 1] == '\'') {
+            for (p += len + 2; *p == ' ' || *p == ':'; p++);
+            return p;
+        }
+    }
+
+    return NULL;
+}
+
+
+static char **split_names (char *names, int *nvars) {
+
+    /* split a comma-separated list of names into an array of copies */
+
+    char **varnames;
+    char *list, *name;
+    int i;
+
+    for (*nvars = 1, i = 0; names[i] != '\0'; i++) {
+        *nvars += (names[i] == ',');
+    }
+
+    varnames = (char **) emalloc(*nvars * sizeof(char *));
+    list = estrdup(names);
+    for (i = 0, name = strtok(list, ","); name != NULL && i < *nvars; name = strtok(NULL, ",")) {
+        varnames[i++] = estrdup(name);
+    }
+    *nvars = i;
+    free(list);
+
+    return varnames;
+}
@@ -0,0 +1,50 @@
+/* npyfile.h */
+
+/*
+
+Copyright (C) 2015 Scott A. Czepiel
+
+    This file is part of mlelr.
+
+    mlelr is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    mlelr is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with mlelr.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef NPYFILE_H__
+#define NPYFILE_H__
+
+/***
+    NumPy and raw matrix files
+
+    A matrix of doubles written by numpy.save, or simply dumped as raw
+    bytes, already has the layout of the rows of a dataset: each row is
+    nvars consecutive doubles, one row after another.  Such a file is
+    mapped and its rows are used where they lie, without parsing or
+    copying them.
+
+    A .npy file must hold a 1 or 2 dimensional array of '<f8' (or '>f8' on
+    a big-endian host) in C order.  Any file that does not begin with the
+    .npy magic string is taken as raw doubles in host byte order, with as
+    many columns as there are names.
+***/
+
+#define NPY_MAGIC       "\x93NUMPY"
+#define NPY_MAGIC_LEN   6
+
+
+/* forward declarations for publically available functions defined in npyfile.c */
+
+extern int load_npy (char *handle, char *filename, char *names);
+
+#endif
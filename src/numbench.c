@@ -0,0 +1,178 @@
+/* numbench.c */
+
+/*
+
+Copyright (C) 2015 Scott A. Czepiel
+
+    This file is part of mlelr.
+
+    mlelr is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    mlelr is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with mlelr.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/***
+    numbench
+
+    A microbenchmark of parse_double against string_to_double (strtod) on
+    the fields of one or more data files.  Every field of every data row is
+    read into memory first, so that only numeric conversion is timed, and
+    the two results are compared bit for bit.
+
+    Usage:  numbench ../data/ucla.dat ../data/ingots.dat ../data/alligator.dat
+***/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "csv.h"
+#include "numparse.h"
+
+static const long MIN_CONVERSIONS = 20000000;   /* per method, per file */
+
+static double seconds_now (void);
+static char guess_delimiter (char *line);
+
+
+int main (int argc, char *argv[]) {
+
+    FILE *ifp;
+    csvparser *cp;
+    char *line;
+    char delim;
+    char **fields;
+    int *lengths;
+    int nfields, maxfields;
+    int a, i, r, reps;
+    int mismatches;
+    double *d1, *d2;
+    double start, t_strtod, t_fast;
+    volatile double sink = 0;
+
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s file [file ...]\n", argv[0]);
+        return 1;
+    }
+
+    printf("%-28s%10s%14s%14s%10s%12s\n", "File", "Fields", "strtod ns", "parse ns", "Speedup", "Mismatches");
+
+    for (a = 1; a < argc; a++) {
+
+        if ((ifp = fopen(argv[a], "r")) == NULL) {
+            fprintf(stderr, "Could not open file: %s\n", argv[a]);
+            continue;
+        }
+
+        /* the header row tells us the delimiter, and is not timed */
+        cp = csvnew();
+        if ((line = csvgetline_r(cp, ifp, '\t', 0)) == NULL) {
+            fclose(ifp);
+            csvfree(cp);
+            continue;
+        }
+        delim = guess_delimiter(line);
+
+        /* collect every data field */
+        nfields = 0;
+        maxfields = 1024;
+        fields = (char **) malloc(maxfields * sizeof(char *));
+        lengths = (int *) malloc(maxfields * sizeof(int));
+        while (csvgetline_r(cp, ifp, delim, 0) != NULL) {
+            for (i = 0; i < csvnfield_r(cp); i++) {
+                if (nfields >= maxfields) {
+                    maxfields *= 2;
+                    fields = (char **) realloc(fields, maxfields * sizeof(char *));
+                    lengths = (int *) realloc(lengths, maxfields * sizeof(int));
+                }
+                fields[nfields] = strdup(csvfield_r(cp, i));
+                lengths[nfields] = strlen(fields[nfields]);
+                nfields++;
+            }
+        }
+        fclose(ifp);
+        csvfree(cp);
+
+        if (nfields == 0) {
+            continue;
+        }
+
+        d1 = (double *) malloc(nfields * sizeof(double));
+        d2 = (double *) malloc(nfields * sizeof(double));
+        reps = (int) (MIN_CONVERSIONS / nfields) + 1;
+
+        start = seconds_now();
+        for (r = 0; r < reps; r++) {
+            for (i = 0; i < nfields; i++) {
+                if (string_to_double(fields[i], &d1[i]) < 0)
+                    d1[i] = -1;
+            }
+            sink += d1[r % nfields];
+        }
+        t_strtod = seconds_now() - start;
+
+        start = seconds_now();
+        for (r = 0; r < reps; r++) {
+            for (i = 0; i < nfields; i++) {
+                if (parse_double(fields[i], lengths[i], &d2[i]) < 0)
+                    d2[i] = -1;
+            }
+            sink += d2[r % nfields];
+        }
+        t_fast = seconds_now() - start;
+
+        for (i = 0, mismatches = 0; i < nfields; i++) {
+            if (memcmp(&d1[i], &d2[i], sizeof(double)) != 0) {
+                mismatches++;
+            }
+        }
+
+        printf("%-28s%10d%14.2f%14.2f%9.1fx%12d\n", argv[a], nfields,
+            t_strtod * 1e9 / ((double) reps * nfields),
+            t_fast * 1e9 / ((double) reps * nfields),
+            t_strtod / t_fast, mismatches);
+
+        for (i = 0; i < nfields; i++) {
+            free(fields[i]);
+        }
+        free(fields);
+        free(lengths);
+        free(d1);
+        free(d2);
+    }
+
+    return 0;
+}
+
+
+static double seconds_now (void) {
+
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+
+}
+
+
+static char guess_delimiter (char *line) {
+
+    /* the bundled data files are tab or space delimited, check for a comma too */
+    if (strchr(line, '\t') != NULL)
+        return '\t';
+    else if (strchr(line, ',') != NULL)
+        return ',';
+    else
+        return ' ';
+
+}
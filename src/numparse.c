@@ -0,0 +1,184 @@
+/* import.c */
+
+/*
+
+Copyright (C) 2015 Scott A. Czepiel
+
+    This file is part of mlelr.
+
+    mlelr is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    mlelr is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with mlelr.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <stdint.h>
+#include "numparse.h"
+
+/***
+    Numeric conversion of data fields.
+
+    Nearly every field we import is a short integer (a count, a category
+    code) or a short decimal such as 3.61.  strtod handles these correctly,
+    but it is written to handle everything: locales, hex floats, infinities,
+    arbitrarily long mantissas.  It also needs a terminated string, which
+    the mapped import path cannot give it without a copy.
+
+    parse_double takes a pointer and a length.  If the whole field is an
+    optional sign, at most 18 digits with an optional decimal point, and
+    nothing else, the digits are accumulated into an integer m.  If m fits
+    in the 53 bits of a double mantissa and there are at most 22 digits
+    after the point, then both m and 10^k are exactly representable, and a
+    single IEEE division m / 10^k is correctly rounded (Clinger's fast path).
+    So the result is bit for bit the same as strtod's.  Anything else is
+    handed to strtod by way of string_to_double.
+***/
+
+/* powers of ten that are exactly representable as doubles */
+static const double exact_pow10[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static const int MAX_FAST_DIGITS = 18;      /* never overflows a uint64_t */
+static const int MAX_FAST_FRACTION = 22;    /* largest exact power of ten */
+
+static int parse_slow (const char *p, int len, double *d);
+
+
+int parse_double (const char *p, int len, double *d) {
+
+    /* convert the len chars at p, with the same return values as string_to_double */
+
+    const char *s = p;
+    const char *end = p + len;
+    uint64_t m = 0;
+    int neg = 0;
+    int ndigits = 0;
+    int nfrac = 0;
+
+    if (s < end && (*s == '-' || *s == '+')) {
+        neg = (*s == '-');
+        s++;
+    }
+
+    /* integer part */
+    for ( ; s < end && *s >= '0' && *s <= '9'; s++, ndigits++) {
+        m = 10 * m + (*s - '0');
+        if (ndigits >= MAX_FAST_DIGITS) {
+            return parse_slow(p, len, d);
+        }
+    }
+
+    /* fraction part */
+    if (s < end && *s == '.') {
+        for (s++; s < end && *s >= '0' && *s <= '9'; s++, ndigits++, nfrac++) {
+            m = 10 * m + (*s - '0');
+            if (ndigits >= MAX_FAST_DIGITS) {
+                return parse_slow(p, len, d);
+            }
+        }
+    }
+
+    /* anything unusual, such as an exponent or trailing text, is strtod's problem */
+    if (s != end || ndigits == 0 || m > ((uint64_t) 1 << 53) || nfrac > MAX_FAST_FRACTION) {
+        return parse_slow(p, len, d);
+    }
+
+    *d = (nfrac == 0) ? (double) m : (double) m / exact_pow10[nfrac];
+    if (neg) {
+        *d = -*d;
+    }
+
+    return 0;
+
+}
+
+
+int string_to_double(char *str, double* d) {
+
+    char *endptr;
+
+    /* clear any error left over from an earlier call so it is not mistaken for underflow */
+    errno = 0;
+
+    *d = strtod(str, &endptr);
+
+    /***
+    Possible outcomes of strtod:
+        0 Successful conversion
+        1  Successful conversion with overflow, result set to +Infinity
+        2  Successful conversion with overflow, result set to -Infinity
+        3  Successful conversion with underflow, result set to 0
+        4  Successful conversion, result parsed as NaN
+    -1  Failed conversion
+
+    pseudo code:
+    if retval == 0
+        if errno != 0 then underflow occurred, treat as successful
+        else if endptr == str then conversion failed
+        else success
+    else if retval isinf() or isnan()
+        then one of the special cases was detected
+
+    ***/
+
+    if (*d == 0) {
+        if (errno != 0) {
+            /* Success, underflow */
+            return 3;
+        }
+        else if (endptr - str == 0) {
+            /* FAIL */
+            return -1;
+        }
+        else {
+            /* Success */
+            return 0;
+        }
+    }
+    else if (isnan(*d))           return 4;   /* Success, NaN */
+    else if (isinf(*d) && *d > 0) return 1;   /* Success, +Inf */
+    else if (isinf(*d) && *d < 0) return 2;   /* Success, -Inf */
+    else return 0;  /* Success */
+
+}
+
+
+static int parse_slow (const char *p, int len, double *d) {
+
+    /* terminate a copy of the field for strtod */
+
+    char small[64];
+    char *str;
+    int ret;
+
+    str = (len < (int) sizeof(small)) ? small : (char *) malloc(len + 1);
+    if (str == NULL) {
+        return -1;
+    }
+
+    memcpy(str, p, len);
+    str[len] = '\0';
+    ret = string_to_double(str, d);
+
+    if (str != small) {
+        free(str);
+    }
+
+    return ret;
+
+}
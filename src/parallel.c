@@ -0,0 +1,69 @@
+/* parallel.c */
+
+/*
+
+Copyright (C) 2015 Scott A. Czepiel
+
+    This file is part of mlelr.
+
+    mlelr is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    mlelr is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with mlelr.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "dataset.h"
+#include "interface.h"
+#include "parallel.h"
+
+
+/* public function definitions */
+
+void run_parallel (void *parts, size_t stride, int nparts, void *(*phase) (void *)) {
+
+    char *part = (char *) parts;
+    pthread_t *tids;
+    int *started;
+    int k;
+
+    if (nparts < 1) {
+        return;
+    }
+    if (nparts == 1) {
+        phase(part);
+        return;
+    }
+
+    tids = (pthread_t *) emalloc(nparts * sizeof(pthread_t));
+    started = (int *) emalloc(nparts * sizeof(int));
+    for (k = 1; k < nparts; k++) {
+        started[k] = (pthread_create(&tids[k], NULL, phase, part + k * stride) == 0);
+    }
+    phase(part);
+
+    /* any part without a thread of its own is run here */
+    for (k = 1; k < nparts; k++) {
+        if (started[k]) {
+            pthread_join(tids[k], NULL);
+        }
+        else {
+            phase(part + k * stride);
+        }
+    }
+
+    free(started);
+    free(tids);
+
+}
@@ -0,0 +1,45 @@
+/* parallel.h */
+
+/*
+
+Copyright (C) 2015 Scott A. Czepiel
+
+    This file is part of mlelr.
+
+    mlelr is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    mlelr is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with mlelr.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef PARALLEL_H__
+#define PARALLEL_H__
+
+#include <stddef.h>
+
+/***
+    run_parallel
+
+    Run phase on each of nparts parts, the first on the calling thread
+    and each of the others on a thread of its own, and return once all
+    of them are done.  parts is an array of any struct, stride bytes
+    apart, and phase is passed a pointer to one element.  A part whose
+    thread cannot be started is run on the calling thread instead, so
+    every part is always run.
+***/
+
+
+/* forward declarations for publically available functions defined in parallel.c */
+
+extern void run_parallel (void *parts, size_t stride, int nparts, void *(*phase) (void *));
+
+#endif
@@ -0,0 +1,214 @@
+/* radixsort.c */
+
+/*
+
+Copyright (C) 2015 Scott A. Czepiel
+
+    This file is part of mlelr.
+
+    mlelr is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    mlelr is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with mlelr.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "dataset.h"
+#include "interface.h"
+#include "parallel.h"
+#include "radixsort.h"
+
+#define RADIX_BITS  8
+#define RADIX       (1 << RADIX_BITS)
+
+/* the fewest rows each thread is given, so that small sorts run on one thread */
+static const int MIN_THREAD_ROWS = 1 << 16;
+
+/***
+    sort_part
+
+    One thread's share of the array for one pass: a slice of the rows
+    and their keys, the count of each digit in the slice, and then where
+    in the output each digit of the slice goes.
+***/
+typedef struct {
+    double  **rows;         /* all rows, in the order of the last pass */
+    uint64_t *keys;         /* their keys */
+    double  **to_rows;      /* where this pass puts the rows */
+    uint64_t *to_keys;      /* and their keys */
+    int       first;        /* first row of the slice */
+    int       count;        /* number of rows in the slice */
+    int       col;          /* column to take the keys from before counting, or -1 to keep them */
+    int       shift;        /* bit position of the digit this pass sorts on */
+    size_t    counts[RADIX];    /* rows with each digit, then the next output position for each */
+} sort_part;
+
+static uint64_t sort_key (double v);
+static void *count_part (void *arg);
+static void *scatter_part (void *arg);
+
+
+/* public function definitions */
+
+void radix_sort_rows (double **rows, int n, int ncols, int nthreads) {
+
+    sort_part *parts;
+    double **buf_rows;
+    uint64_t *keys, *buf_keys;
+    double **from_rows, **to_rows, **swap_rows;
+    uint64_t *from_keys, *to_keys, *swap_keys;
+    size_t pos, total;
+    int nparts, col, shift, d, k;
+
+    if (n < 2 || ncols < 1) {
+        return;
+    }
+
+    nparts = (nthreads > 1) ? nthreads : 1;
+    if (nparts > n / MIN_THREAD_ROWS) {
+        nparts = (n / MIN_THREAD_ROWS > 1) ? n / MIN_THREAD_ROWS : 1;
+    }
+
+    buf_rows = (double **) emalloc(n * sizeof(double *));
+    keys = (uint64_t *) emalloc(n * sizeof(uint64_t));
+    buf_keys = (uint64_t *) emalloc(n * sizeof(uint64_t));
+    parts = (sort_part *) emalloc(nparts * sizeof(sort_part));
+    for (k = 0; k < nparts; k++) {
+        parts[k].first = (int) ((long long) n * k / nparts);
+        parts[k].count = (int) ((long long) n * (k + 1) / nparts) - parts[k].first;
+    }
+
+    from_rows = rows;
+    from_keys = keys;
+    to_rows = buf_rows;
+    to_keys = buf_keys;
+
+    /* least significant first: the last column's lowest byte, up to the first column's highest */
+    for (col = ncols - 1; col >= 0; col--) {
+        for (shift = 0; shift < 64; shift += RADIX_BITS) {
+
+            for (k = 0; k < nparts; k++) {
+                parts[k].rows = from_rows;
+                parts[k].keys = from_keys;
+                parts[k].to_rows = to_rows;
+                parts[k].to_keys = to_keys;
+                parts[k].col = (shift == 0) ? col : -1;
+                parts[k].shift = shift;
+            }
+            run_parallel(parts, sizeof(sort_part), nparts, count_part);
+
+            /* a pass where every row has the same digit would move nothing */
+            for (d = 0, total = 0; d < RADIX && total == 0; d++) {
+                for (k = 0; k < nparts; k++) {
+                    total += parts[k].counts[d];
+                }
+            }
+            if (total == (size_t) n) {
+                continue;
+            }
+
+            /* each digit's rows go after all smaller digits, and each slice's after those before it */
+            for (d = 0, pos = 0; d < RADIX; d++) {
+                for (k = 0; k < nparts; k++) {
+                    total = parts[k].counts[d];
+                    parts[k].counts[d] = pos;
+                    pos += total;
+                }
+            }
+            run_parallel(parts, sizeof(sort_part), nparts, scatter_part);
+
+            swap_rows = from_rows;
+            from_rows = to_rows;
+            to_rows = swap_rows;
+            swap_keys = from_keys;
+            from_keys = to_keys;
+            to_keys = swap_keys;
+        }
+    }
+
+    if (from_rows != rows) {
+        memcpy(rows, from_rows, n * sizeof(double *));
+    }
+
+    free(parts);
+    free(buf_keys);
+    free(keys);
+    free(buf_rows);
+
+}
+
+
+/* static function definitions */
+
+static uint64_t sort_key (double v) {
+
+    /***
+        Map v to an unsigned integer in the same order.  Flipping the sign
+        bit of a positive value, and every bit of a negative one, orders
+        the bits of IEEE doubles as their values.  -0 is first made 0, as
+        the two compare equal.
+    ***/
+
+    uint64_t bits;
+
+    memcpy(&bits, &v, sizeof(bits));
+    if (v == 0) {
+        bits = 0;
+    }
+
+    return (bits >> 63) ? ~bits : bits | ((uint64_t) 1 << 63);
+}
+
+
+static void *count_part (void *arg) {
+
+    /* take the keys of the slice if this pass starts a column, and count each digit */
+
+    sort_part *p = (sort_part *) arg;
+    int i;
+    int end = p->first + p->count;
+
+    if (p->col >= 0) {
+        for (i = p->first; i < end; i++) {
+            p->keys[i] = sort_key(p->rows[i][p->col]);
+        }
+    }
+
+    memset(p->counts, 0, sizeof(p->counts));
+    for (i = p->first; i < end; i++) {
+        p->counts[(p->keys[i] >> p->shift) & (RADIX - 1)]++;
+    }
+
+    return NULL;
+}
+
+
+static void *scatter_part (void *arg) {
+
+    /* move each row of the slice, and its key, to the next position for its digit */
+
+    sort_part *p = (sort_part *) arg;
+    size_t to;
+    int i;
+    int end = p->first + p->count;
+
+    for (i = p->first; i < end; i++) {
+        to = p->counts[(p->keys[i] >> p->shift) & (RADIX - 1)]++;
+        p->to_rows[to] = p->rows[i];
+        p->to_keys[to] = p->keys[i];
+    }
+
+    return NULL;
+}
@@ -0,0 +1,45 @@
+/* radixsort.h */
+
+/*
+
+Copyright (C) 2015 Scott A. Czepiel
+
+    This file is part of mlelr.
+
+    mlelr is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    mlelr is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with mlelr.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef RADIXSORT_H__
+#define RADIXSORT_H__
+
+/***
+    radix_sort_rows
+
+    Sort an array of row pointers by the first ncols values of each row,
+    in the order compare_obs gave with qsort: ascending by the first
+    value, then the second, and so on, with -0 equal to 0.  The sort is
+    an LSD radix sort, one byte at a time, of each value mapped to an
+    unsigned key in the same order, and is stable, so rows with equal
+    keys keep their order.  Large arrays are counted and scattered by
+    nthreads threads.  Nothing static is used, so any number of sorts may
+    run at once.
+***/
+
+
+/* forward declarations for publically available functions defined in radixsort.c */
+
+extern void radix_sort_rows (double **rows, int n, int ncols, int nthreads);
+
+#endif
@@ -0,0 +1,159 @@
+/* rowhash.c */
+
+/*
+
+Copyright (C) 2015 Scott A. Czepiel
+
+    This file is part of mlelr.
+
+    mlelr is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    mlelr is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with mlelr.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dataset.h"
+#include "interface.h"
+#include "rowhash.h"
+
+static uint32_t hash_key (const double *key, int width);
+static void grow_rowhash (rowhash *h);
+
+
+void init_rowhash (rowhash *h, int width) {
+
+    int i;
+
+    h->size = 64;
+    h->n = 0;
+    h->width = width;
+    h->rows = (int *) emalloc(h->size * sizeof(int));
+    h->hashes = (uint32_t *) emalloc(h->size * sizeof(uint32_t));
+    for (i = 0; i < h->size; i++) {
+        h->rows[i] = -1;
+    }
+
+}
+
+
+void free_rowhash (rowhash *h) {
+
+    free(h->rows);
+    free(h->hashes);
+    h->rows = NULL;
+    h->hashes = NULL;
+    h->size = h->n = 0;
+
+}
+
+
+int rowhash_find (rowhash *h, dataset *ds, const double *key) {
+
+    /* return the row of ds whose key equals key, or -1 if there is none */
+
+    uint32_t hash;
+    int i, j, row;
+
+    hash = hash_key(key, h->width);
+
+    /* linear probing from the home slot until an empty slot ends the search */
+    for (i = hash & (h->size - 1); (row = h->rows[i]) != -1; i = (i + 1) & (h->size - 1)) {
+        if (h->hashes[i] == hash) {
+            for (j = 0; j < h->width && ds->obs[row][j] == key[j]; j++);
+            if (j == h->width) {
+                return row;
+            }
+        }
+    }
+
+    return -1;
+}
+
+
+void rowhash_add (rowhash *h, dataset *ds, int row) {
+
+    /* index row of ds, which the caller knows is not already present */
+
+    uint32_t hash;
+    int i;
+
+    /* keep the table at most half full so that probe sequences stay short */
+    if (2 * (h->n + 1) > h->size) {
+        grow_rowhash(h);
+    }
+
+    hash = hash_key(ds->obs[row], h->width);
+    for (i = hash & (h->size - 1); h->rows[i] != -1; i = (i + 1) & (h->size - 1));
+    h->rows[i] = row;
+    h->hashes[i] = hash;
+    h->n++;
+
+}
+
+
+
+
+/* static function definitions */
+
+static uint32_t hash_key (const double *key, int width) {
+
+    /* mix the bits of each value; 0 is used for -0 so that the two hash alike */
+
+    uint64_t h = 0x9e3779b97f4a7c15ULL;
+    uint64_t bits;
+    double v;
+    int j;
+
+    for (j = 0; j < width; j++) {
+        v = (key[j] == 0) ? 0.0 : key[j];
+        memcpy(&bits, &v, sizeof(bits));
+        h = (h ^ bits) * 0xff51afd7ed558ccdULL;
+        h ^= h >> 32;
+    }
+
+    return (uint32_t) h;
+}
+
+
+static void grow_rowhash (rowhash *h) {
+
+    /* double the number of slots and reinsert every row */
+
+    int *oldrows = h->rows;
+    uint32_t *oldhashes = h->hashes;
+    int oldsize = h->size;
+    int i, k;
+
+    h->size *= 2;
+    h->rows = (int *) emalloc(h->size * sizeof(int));
+    h->hashes = (uint32_t *) emalloc(h->size * sizeof(uint32_t));
+    for (i = 0; i < h->size; i++) {
+        h->rows[i] = -1;
+    }
+
+    for (i = 0; i < oldsize; i++) {
+        if (oldrows[i] != -1) {
+            for (k = oldhashes[i] & (h->size - 1); h->rows[k] != -1; k = (k + 1) & (h->size - 1));
+            h->rows[k] = oldrows[i];
+            h->hashes[k] = oldhashes[i];
+        }
+    }
+
+    free(oldrows);
+    free(oldhashes);
+
+    printlog(VERBOSE, "Row hash grown to %d slots for %d rows\n", h->size, h->n);
+
+}
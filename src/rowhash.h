@@ -0,0 +1,54 @@
+/* rowhash.h */
+
+/*
+
+Copyright (C) 2015 Scott A. Czepiel
+
+    This file is part of mlelr.
+
+    mlelr is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    mlelr is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with mlelr.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef ROWHASH_H__
+#define ROWHASH_H__
+
+#include <stdint.h>
+
+/***
+    rowhash
+
+    An open-addressing hash index over the rows of a dataset, keyed on the
+    first width values of each row.  Keys are compared with ==, exactly as
+    find_observation compares them, so -0 matches 0 and NaN matches nothing.
+    The index stores row numbers, not copies of the rows, so it adds only a
+    few bytes per row to the dataset it indexes.
+***/
+typedef struct {
+    int      *rows;         /* row number in the dataset for each slot, or -1 if empty */
+    uint32_t *hashes;       /* hash of the key of each occupied slot */
+    int       size;         /* number of slots, always a power of two */
+    int       n;            /* number of rows indexed */
+    int       width;        /* number of leading values in each row that form the key */
+} rowhash;
+
+
+/* forward declarations for publically available functions defined in rowhash.c */
+
+extern void init_rowhash (rowhash *h, int width);
+extern void free_rowhash (rowhash *h);
+extern int rowhash_find (rowhash *h, dataset *ds, const double *key);
+extern void rowhash_add (rowhash *h, dataset *ds, int row);
+
+#endif
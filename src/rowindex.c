@@ -0,0 +1,258 @@
+/* rowindex.c */
+
+/*
+
+Copyright (C) 2015 Scott A. Czepiel
+
+    This file is part of mlelr.
+
+    mlelr is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    mlelr is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with mlelr.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dataset.h"
+#include "interface.h"
+#include "rowindex.h"
+
+static char *index_filename (char *filename, char *suffix);
+
+
+void init_rowindex (rowindex *ix) {
+
+    ix->nfields = 0;
+    ix->varnames = NULL;
+    ix->header = 0;
+    ix->nrows = 0;
+    ix->nmarks = 0;
+    ix->size = 0;
+    ix->rows = NULL;
+    ix->offsets = NULL;
+
+}
+
+
+void free_rowindex (rowindex *ix) {
+
+    int j;
+
+    for (j = 0; j < ix->nfields; j++) {
+        free(ix->varnames[j]);
+    }
+    free(ix->varnames);
+    free(ix->rows);
+    free(ix->offsets);
+    init_rowindex(ix);
+
+}
+
+
+void rowindex_mark (rowindex *ix, long long row, long long offset) {
+
+    /* record that row starts at offset; marks must be added in row order */
+
+    if (ix->nmarks == ix->size) {
+        ix->size = (ix->size > 0) ? 2 * ix->size : 64;
+        ix->rows = (long long *) erealloc(ix->rows, ix->size * sizeof(long long));
+        ix->offsets = (long long *) erealloc(ix->offsets, ix->size * sizeof(long long));
+    }
+    ix->rows[ix->nmarks] = row;
+    ix->offsets[ix->nmarks] = offset;
+    ix->nmarks++;
+
+}
+
+
+int rowindex_before (rowindex *ix, long long row) {
+
+    /* return the last mark at or before row, or -1 if there is none */
+
+    int lo = 0;
+    int hi = ix->nmarks;
+    int mid;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (ix->rows[mid] <= row) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+
+    return lo - 1;
+}
+
+
+int read_rowindex (rowindex *ix, char *filename, char delim, struct stat *st) {
+
+    /***
+        Read the index of filename into ix, which must be freshly initialized.
+        Return -1, leaving ix empty, if there is no index or it does not
+        match the file as described by st.
+    ***/
+
+    FILE *ifp;
+    rowindex_header hdr;
+    char *ixname, *names, *name;
+    int j;
+    int ok;
+
+    ixname = index_filename(filename, "");
+    ifp = fopen(ixname, "rb");
+    free(ixname);
+    if (ifp == NULL) {
+        return -1;
+    }
+
+    ok = fread(&hdr, sizeof(hdr), 1, ifp) == 1
+        && memcmp(hdr.magic, ROWINDEX_MAGIC, sizeof(ROWINDEX_MAGIC)) == 0
+        && hdr.version == ROWINDEX_VERSION && hdr.byteorder == ROWINDEX_BYTEORDER
+        && hdr.size == (int64_t) st->st_size && hdr.mtime == (int64_t) st->st_mtim.tv_sec
+        && hdr.mtime_nsec == (int64_t) st->st_mtim.tv_nsec && hdr.delim == (unsigned char) delim
+        && hdr.nfields > 0 && hdr.names > 0 && hdr.names < (1 << 24) && hdr.nfields <= hdr.names
+        && hdr.nmarks >= 0 && hdr.nmarks < (1 << 28) && hdr.header <= hdr.size;
+
+    if (!ok) {
+        printlog(VERBOSE, "%s%s\n", "Ignoring stale or unreadable row index for: ", filename);
+        fclose(ifp);
+        return -1;
+    }
+
+    /* the names must hold exactly nfields strings */
+    names = (char *) emalloc(hdr.names);
+    ok = fread(names, hdr.names, 1, ifp) == 1 && names[hdr.names - 1] == '\0';
+    ix->varnames = (char **) emalloc(hdr.nfields * sizeof(char *));
+    for (j = 0, name = names; ok && j < (int) hdr.nfields; j++) {
+        if (name >= names + hdr.names) {
+            ok = 0;
+            break;
+        }
+        ix->varnames[j] = estrdup(name);
+        ix->nfields++;
+        name += strlen(name) + 1;
+    }
+    ok = ok && name == names + hdr.names;
+    free(names);
+
+    if (ok && hdr.nmarks > 0) {
+        ix->size = ix->nmarks = hdr.nmarks;
+        ix->rows = (long long *) emalloc(hdr.nmarks * sizeof(long long));
+        ix->offsets = (long long *) emalloc(hdr.nmarks * sizeof(long long));
+        ok = fread(ix->rows, sizeof(long long), hdr.nmarks, ifp) == (size_t) hdr.nmarks
+            && fread(ix->offsets, sizeof(long long), hdr.nmarks, ifp) == (size_t) hdr.nmarks;
+        for (j = 0; ok && j < ix->nmarks; j++) {
+            ok = ix->offsets[j] >= hdr.header && ix->offsets[j] <= hdr.size
+                && ix->rows[j] <= hdr.nrows && (j == 0 || ix->rows[j] > ix->rows[j-1]);
+        }
+    }
+    fclose(ifp);
+
+    if (!ok) {
+        printlog(VERBOSE, "%s%s\n", "Ignoring corrupt row index for: ", filename);
+        free_rowindex(ix);
+        return -1;
+    }
+
+    ix->header = hdr.header;
+    ix->nrows = hdr.nrows;
+
+    return 0;
+}
+
+
+int write_rowindex (rowindex *ix, char *filename, char delim, struct stat *st) {
+
+    /***
+        Write ix as the index of filename, whose state before it was read
+        is described by st.  The index is written under a temporary name
+        and then renamed, so a reader never sees a partial index.  Failing
+        to write an index is not an error, since it is only an aid.
+    ***/
+
+    FILE *ofp;
+    rowindex_header hdr;
+    char *ixname, *tmpname;
+    int j;
+    int ok = 1;
+
+    memset(&hdr, 0, sizeof(hdr));
+    strcpy(hdr.magic, ROWINDEX_MAGIC);
+    hdr.version = ROWINDEX_VERSION;
+    hdr.byteorder = ROWINDEX_BYTEORDER;
+    hdr.size = st->st_size;
+    hdr.mtime = st->st_mtim.tv_sec;
+    hdr.mtime_nsec = st->st_mtim.tv_nsec;
+    hdr.delim = (unsigned char) delim;
+    hdr.nfields = ix->nfields;
+    hdr.header = ix->header;
+    hdr.nrows = ix->nrows;
+    hdr.nmarks = ix->nmarks;
+    for (j = 0; j < ix->nfields; j++) {
+        hdr.names += strlen(ix->varnames[j]) + 1;
+    }
+
+    ixname = index_filename(filename, "");
+    tmpname = index_filename(filename, ".tmp");
+
+    if ((ofp = fopen(tmpname, "wb")) == NULL) {
+        printlog(VERBOSE, "%s%s\n", "Could not write row index: ", tmpname);
+        free(ixname);
+        free(tmpname);
+        return -1;
+    }
+
+    ok = fwrite(&hdr, sizeof(hdr), 1, ofp) == 1;
+    for (j = 0; ok && j < ix->nfields; j++) {
+        ok = fwrite(ix->varnames[j], strlen(ix->varnames[j]) + 1, 1, ofp) == 1;
+    }
+    ok = ok && fwrite(ix->rows, sizeof(long long), ix->nmarks, ofp) == (size_t) ix->nmarks;
+    ok = ok && fwrite(ix->offsets, sizeof(long long), ix->nmarks, ofp) == (size_t) ix->nmarks;
+
+    if (fclose(ofp) != 0 || !ok || rename(tmpname, ixname) != 0) {
+        printlog(VERBOSE, "%s%s\n", "Could not write row index: ", ixname);
+        remove(tmpname);
+        ok = 0;
+    }
+    else {
+        printlog(VERBOSE, "%s%s\n", "Wrote row index: ", ixname);
+    }
+
+    free(ixname);
+    free(tmpname);
+
+    return ok ? 0 : -1;
+}
+
+
+
+
+/* static function definitions */
+
+static char *index_filename (char *filename, char *suffix) {
+
+    /* the name of the index of filename, followed by suffix */
+
+    char *name;
+
+    name = (char *) emalloc(strlen(filename) + strlen(".idx") + strlen(suffix) + 1);
+    strcpy(name, filename);
+    strcat(name, ".idx");
+    strcat(name, suffix);
+
+    return name;
+}
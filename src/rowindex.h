@@ -0,0 +1,94 @@
+/* rowindex.h */
+
+/*
+
+Copyright (C) 2015 Scott A. Czepiel
+
+    This file is part of mlelr.
+
+    mlelr is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    mlelr is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with mlelr.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef ROWINDEX_H__
+#define ROWINDEX_H__
+
+/***
+    Row index files
+
+    An import of a whole text file leaves beside it a small index, named
+    for the file with .idx appended, so that later imports of the same
+    file can skip reading its header and can find a given row without
+    parsing the rows before it.  The layout, in host byte order, is:
+
+        rowindex_header
+        varnames                    nfields NUL-terminated strings, names bytes in all
+        rows[nmarks]                int64 row number of each mark, counting from 0
+        offsets[nmarks]             int64 file offset of the start of that row
+
+    A mark is recorded about every ROWINDEX_EVERY rows.  The index holds
+    the size and modification time of the file it was made from, and is
+    ignored once either changes.
+***/
+
+#include <stdint.h>
+#include <sys/stat.h>
+
+#define ROWINDEX_MAGIC      "MLELRIX"
+#define ROWINDEX_VERSION    1
+#define ROWINDEX_BYTEORDER  0x01020304
+#define ROWINDEX_EVERY      65536
+
+typedef struct {
+    char     magic[8];      /* ROWINDEX_MAGIC, NUL-terminated */
+    uint32_t version;       /* ROWINDEX_VERSION */
+    uint32_t byteorder;     /* ROWINDEX_BYTEORDER as written by this host */
+    int64_t  size;          /* size of the indexed file */
+    int64_t  mtime;         /* modification time of the indexed file, seconds */
+    int64_t  mtime_nsec;    /* and nanoseconds */
+    uint32_t delim;         /* field delimiter the file was read with */
+    uint32_t nfields;       /* number of fields in each record */
+    int64_t  header;        /* file offset of the first record after the header */
+    int64_t  nrows;         /* number of records after the header */
+    int64_t  names;         /* bytes of variable names */
+    int64_t  nmarks;        /* number of marks */
+} rowindex_header;
+
+/***
+    rowindex
+
+    An index in memory, either read from a file or being built by an import.
+***/
+typedef struct {
+    int         nfields;    /* number of fields in each record */
+    char      **varnames;   /* name of each field, from the header */
+    long long   header;     /* file offset of the first record after the header */
+    long long   nrows;      /* number of records after the header */
+    int         nmarks;     /* number of marks */
+    int         size;       /* space allocated for marks */
+    long long  *rows;       /* row number of each mark, in increasing order */
+    long long  *offsets;    /* file offset of the start of each marked row */
+} rowindex;
+
+
+/* forward declarations for publically available functions defined in rowindex.c */
+
+extern void init_rowindex (rowindex *ix);
+extern void free_rowindex (rowindex *ix);
+extern void rowindex_mark (rowindex *ix, long long row, long long offset);
+extern int rowindex_before (rowindex *ix, long long row);
+extern int read_rowindex (rowindex *ix, char *filename, char delim, struct stat *st);
+extern int write_rowindex (rowindex *ix, char *filename, char delim, struct stat *st);
+
+#endif
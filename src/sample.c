@@ -0,0 +1,230 @@
+/* sample.c */
+
+/*
+
+Copyright (C) 2015 Scott A. Czepiel
+
+    This file is part of mlelr.
+
+    mlelr is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    mlelr is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with mlelr.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dataset.h"
+#include "interface.h"
+#include "sample.h"
+
+static uint64_t mix64 (uint64_t x);
+static void sift_down (reservoir *r, int i);
+static void sift_up (reservoir *r, int i);
+static int row_before (reservoir *r, int a, int b);
+
+
+uint64_t sample_key (uint64_t seed, long long offset) {
+
+    /* a random key for the record at offset, the same every time for a given seed */
+    return mix64(seed ^ mix64((uint64_t) offset));
+}
+
+
+void init_reservoir (reservoir *r, int size, int nvars) {
+
+    r->size = size;
+    r->rows = add_dataset("_reservoir", nvars, NULL, 0);
+    r->keys = (uint64_t *) emalloc(size * sizeof(uint64_t));
+    r->files = (int *) emalloc(size * sizeof(int));
+    r->offsets = (long long *) emalloc(size * sizeof(long long));
+    r->heap = (int *) emalloc(size * sizeof(int));
+
+}
+
+
+void free_reservoir (reservoir *r) {
+
+    free_dataset(r->rows);
+    free(r->keys);
+    free(r->files);
+    free(r->offsets);
+    free(r->heap);
+
+}
+
+
+int reservoir_wants (reservoir *r, uint64_t key) {
+
+    /* would a row with this key be kept?  checked before the row is converted */
+    return r->rows->n < r->size || key < r->keys[r->heap[0]];
+}
+
+
+double *reservoir_slot (reservoir *r, uint64_t key, int file, long long offset) {
+
+    /***
+        Make room for a row with the given key, evicting the row with the
+        largest key if the reservoir is full, and return the row for the
+        caller to fill in.  Return NULL if the row is not wanted.
+    ***/
+
+    int i;
+
+    if (r->rows->n < r->size) {
+        new_observation(r->rows);
+        i = r->rows->n - 1;
+        r->keys[i] = key;
+        r->files[i] = file;
+        r->offsets[i] = offset;
+        r->heap[i] = i;
+        sift_up(r, i);
+    }
+    else if (key < r->keys[r->heap[0]]) {
+        i = r->heap[0];
+        r->keys[i] = key;
+        r->files[i] = file;
+        r->offsets[i] = offset;
+        sift_down(r, 0);
+    }
+    else {
+        return NULL;
+    }
+
+    return r->rows->obs[i];
+}
+
+
+void merge_reservoir (reservoir *r, reservoir *from) {
+
+    /* offer every row of from to r */
+
+    double *row;
+    int i;
+
+    for (i = 0; i < from->rows->n; i++) {
+        if ((row = reservoir_slot(r, from->keys[i], from->files[i], from->offsets[i])) != NULL) {
+            memcpy(row, from->rows->obs[i], r->rows->nvars * sizeof(double));
+        }
+    }
+
+}
+
+
+double **reservoir_rows (reservoir *r) {
+
+    /***
+        Return the rows kept, in file order and then in order within each
+        file, as an array the caller frees.  The rows are merge sorted by
+        index, which needs no comparison function and so no static state.
+    ***/
+
+    int *order, *buf, *swap;
+    double **rows;
+    int n = r->rows->n;
+    int i, width, lo, mid, hi, a, b;
+
+    order = (int *) emalloc((n + 1) * sizeof(int));
+    buf = (int *) emalloc((n + 1) * sizeof(int));
+    for (i = 0; i < n; i++) {
+        order[i] = i;
+    }
+
+    /* merge runs of width rows into runs of twice that, from buf back into order */
+    for (width = 1; width < n; width *= 2) {
+        swap = order;
+        order = buf;
+        buf = swap;
+        for (lo = 0; lo < n; lo += 2 * width) {
+            mid = (lo + width < n) ? lo + width : n;
+            hi = (lo + 2 * width < n) ? lo + 2 * width : n;
+            for (i = lo, a = lo, b = mid; i < hi; i++) {
+                if (a < mid && (b >= hi || !row_before(r, buf[b], buf[a]))) {
+                    order[i] = buf[a++];
+                }
+                else {
+                    order[i] = buf[b++];
+                }
+            }
+        }
+    }
+
+    rows = (double **) emalloc((n + 1) * sizeof(double *));
+    for (i = 0; i < n; i++) {
+        rows[i] = r->rows->obs[order[i]];
+    }
+
+    free(order);
+    free(buf);
+
+    return rows;
+}
+
+
+
+
+/* static function definitions */
+
+static uint64_t mix64 (uint64_t x) {
+
+    /* the splitmix64 finalizer, which spreads every input bit over the whole output */
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+
+static void sift_down (reservoir *r, int i) {
+
+    int child, tmp;
+    int n = r->rows->n;
+
+    while ((child = 2 * i + 1) < n) {
+        if (child + 1 < n && r->keys[r->heap[child + 1]] > r->keys[r->heap[child]]) {
+            child++;
+        }
+        if (r->keys[r->heap[child]] <= r->keys[r->heap[i]]) {
+            break;
+        }
+        tmp = r->heap[i];
+        r->heap[i] = r->heap[child];
+        r->heap[child] = tmp;
+        i = child;
+    }
+
+}
+
+
+static void sift_up (reservoir *r, int i) {
+
+    int parent, tmp;
+
+    while (i > 0 && r->keys[r->heap[parent = (i - 1) / 2]] < r->keys[r->heap[i]]) {
+        tmp = r->heap[i];
+        r->heap[i] = r->heap[parent];
+        r->heap[parent] = tmp;
+        i = parent;
+    }
+
+}
+
+
+static int row_before (reservoir *r, int a, int b) {
+
+    /* does row a of the reservoir come before row b in the files? */
+    if (r->files[a] != r->files[b]) {
+        return r->files[a] < r->files[b];
+    }
+    return r->offsets[a] < r->offsets[b];
+}
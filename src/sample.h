@@ -0,0 +1,59 @@
+/* sample.h */
+
+/*
+
+Copyright (C) 2015 Scott A. Czepiel
+
+    This file is part of mlelr.
+
+    mlelr is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    mlelr is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with mlelr.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef SAMPLE_H__
+#define SAMPLE_H__
+
+#include <stdint.h>
+
+/***
+    reservoir
+
+    A uniform random sample of a fixed number of rows.  Each candidate row
+    carries a random key, and the reservoir keeps the rows with the
+    smallest keys seen so far.  Keys are derived from each row's file
+    offset rather than from a running count, so the same rows are chosen
+    however the file is divided among threads, and two reservoirs filled
+    from different parts of a file merge into the reservoir of the whole.
+***/
+typedef struct {
+    int         size;       /* number of rows to keep */
+    dataset    *rows;       /* the rows kept so far, in no particular order */
+    uint64_t   *keys;       /* random key of each row */
+    int        *files;      /* ordinal of the file each row is from, when several files are read */
+    long long  *offsets;    /* offset of each row in its file, to put the sample back in file order */
+    int        *heap;       /* indexes into rows, arranged as a max-heap on key */
+} reservoir;
+
+
+/* forward declarations for publically available functions defined in sample.c */
+
+extern uint64_t sample_key (uint64_t seed, long long offset);
+extern void init_reservoir (reservoir *r, int size, int nvars);
+extern void free_reservoir (reservoir *r);
+extern int reservoir_wants (reservoir *r, uint64_t key);
+extern double *reservoir_slot (reservoir *r, uint64_t key, int file, long long offset);
+extern void merge_reservoir (reservoir *r, reservoir *from);
+extern double **reservoir_rows (reservoir *r);
+
+#endif
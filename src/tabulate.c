@@ -25,147 +25,297 @@ Copyright (C) 2015 Scott A. Czepiel
 #include <stdlib.h>
 #include <string.h>
 #include "dataset.h"
+#include "arena.h"
 #include "model.h"
 #include "interface.h"
+#include "parallel.h"
+#include "rowhash.h"
 #include "tabulate.h"
 
 static char *freqvars[] = {"Value", "Freq"};
 
-int frequency_table (dataset *ds, int var) {
-
-    dataset *freq;
-    int i, j, found;
+/* number of observations of each variable read at a time */
+static const int BATCH_ROWS = 4096;
+
+/* number of observations in each range that is tabulated on its own */
+static const int TAB_PART_ROWS = 1 << 16;
+
+/***
+    tab_part
+
+    A range of observations whose cells and levels are looked up on a
+    thread of its own.  The distinct cells and levels of the range go in
+    partial tables, with no weights, and each observation records which
+    of their rows it falls in, so that the weights can then be added up
+    on one thread in order of observation.
+***/
+typedef struct {
+    dataset  *ds;           /* the dataset being tabulated */
+    model    *mod;          /* the model whose variables are tabulated */
+    int       first;        /* first observation of the range */
+    int       count;        /* number of observations in the range */
+    dataset  *xtab;         /* distinct cells of the range */
+    dataset **freqs;        /* distinct levels of each uncoded variable in the range */
+    int      *cells;        /* row of xtab for each observation, or -1 if its weight is not positive */
+    int     **levels;       /* row of each uncoded variable's freqs for each observation */
+    double   *weights;      /* weight of each observation */
+} tab_part;
+
+static void *tabulate_part (void *arg);
+static void map_rows (dataset *into, rowhash *index, dataset *from, int *map);
+static void count_levels (dataset *ds, int var, dataset *freq, int positive);
+static void new_tally (dataset *ds, int var, double **sums, char **seen);
+static void add_tally (dataset *ds, int var, dataset *freq, double *sums, char *seen);
+static void read_batch (dataset *ds, int var, int first, int count, double *buf);
+
+int frequency_table (dataset *ds, int *vars, int nvars) {
+
+    /***
+        Print a frequency table for each of the nvars variables in vars,
+        counting them all in a single pass over ds.  A coded variable is
+        tallied by its codes; any other finds its row in its table by
+        hashing the value.
+    ***/
+
+    dataset **freqs;
+    rowhash *levels;
+    double **sums;
+    char **seen;
+    int i, j, k, code;
+    int batch, count;
     double obs[2];
     double target;
     double weight;
+    double **values;
+    double *weights;
     char *handle;
     char *handle_prefix = "Frequency table for: ";
 
-    printlog(VERBOSE, "Building frequency table for variable '%s' in dataset '%s'\n", ds->varnames[var], ds->handle);
+    /* a batch holds about BATCH_ROWS values in all, so that it stays in cache however many variables there are */
+    batch = (BATCH_ROWS / nvars > 16) ? BATCH_ROWS / nvars : 16;
+
+    freqs = (dataset **) emalloc(nvars * sizeof(dataset *));
+    levels = (rowhash *) emalloc(nvars * sizeof(rowhash));
+    sums = (double **) emalloc(nvars * sizeof(double *));
+    seen = (char **) emalloc(nvars * sizeof(char *));
+    values = (double **) emalloc(nvars * sizeof(double *));
+    weights = (double *) emalloc(batch * sizeof(double));
 
+    for (k = 0; k < nvars; k++) {
 
-    handle = (char *) emalloc( strlen(handle_prefix) + strlen(ds->varnames[var]) + 1 );
-    strcpy(handle, handle_prefix);
-    strcat(handle, ds->varnames[var]);
+        printlog(VERBOSE, "Building frequency table for variable '%s' in dataset '%s'\n", ds->varnames[vars[k]], ds->handle);
 
-    freq = add_dataset(handle, 2, freqvars, 0);
+        handle = (char *) emalloc( strlen(handle_prefix) + strlen(ds->varnames[vars[k]]) + 1 );
+        strcpy(handle, handle_prefix);
+        strcat(handle, ds->varnames[vars[k]]);
+        freqs[k] = add_dataset(handle, 2, freqvars, 0);
+        free(handle);
+
+        /* a coded variable is counted by its codes, with no search */
+        if (is_coded(ds, vars[k])) {
+            new_tally(ds, vars[k], &sums[k], &seen[k]);
+            values[k] = NULL;
+        }
+        else {
+            init_rowhash(&levels[k], 1);
+            values[k] = (double *) emalloc(batch * sizeof(double));
+        }
+    }
+
+    advise_dataset(ds, 1);
 
     /* loop for each observation in the dataset */
-    for (i = 0; i < ds->n; i++) {
+    for (i = 0, count = 0; i < ds->n; i++) {
+
+        /* read the next batch of each variable and the weight, a column at a time */
+        if (i % batch == 0) {
+            count = (ds->n - i < batch) ? ds->n - i : batch;
+            for (k = 0; k < nvars; k++) {
+                if (values[k] != NULL) {
+                    read_batch(ds, vars[k], i, count, values[k]);
+                }
+            }
+            read_batch(ds, ds->weight, i, count, weights);
+        }
+
+        weight = weights[i % batch];
+
+        /* loop for each variable to tabulate */
+        for (k = 0; k < nvars; k++) {
+
+            if (values[k] == NULL) {
+                code = get_code(ds, i, vars[k]);
+                sums[k][code] = (seen[k][code]) ? sums[k][code] + weight : weight;
+                seen[k][code] = 1;
+                continue;
+            }
+
+            target = values[k][i % batch];
 
-        target = ds->obs[i][var];
-        weight = (ds->weight == -1) ? 1.0 : ds->obs[i][ds->weight];
+            /* search for the target value in the existing frequency table */
+            j = rowhash_find(&levels[k], freqs[k], &target);
 
-        /* search for the target value in the existing frequency table */
-        for (j = 0, found = 0; j < freq->n; j++) {
-            if (target == freq->obs[j][0]) {
-                found = 1;
-                break;
+            /* if not found, add to the frequency table */
+            if (j == -1) {
+                obs[0] = target;
+                obs[1] = weight;
+                add_observation(freqs[k], obs);
+                rowhash_add(&levels[k], freqs[k], freqs[k]->n - 1);
             }
+            /* otherwise, increment the frequency table */
+            else {
+                freqs[k]->obs[j][1] += weight;
+            }
+
         }
 
-        /* if not found, add to the frequency table */
-        if (!found) {
-            obs[0] = target;
-            obs[1] = weight;
-            add_observation(freq, obs);
+    }
+    advise_dataset(ds, 0);
+
+    /* sort and print each table in the order the variables were given */
+    for (k = 0; k < nvars; k++) {
+        if (values[k] == NULL) {
+            add_tally(ds, vars[k], freqs[k], sums[k], seen[k]);
         }
-        /* otherwise, increment the frequency table */
         else {
-            freq->obs[j][1] += weight;
+            free_rowhash(&levels[k]);
+            free(values[k]);
         }
-
+        sort_dataset(freqs[k], 1);
+        print_dataset(freqs[k], 0, 1);
+        free_dataset(freqs[k]);
     }
-    sort_dataset(freq, 1);
-    print_dataset(freq, 0, 1);
+
+    free(freqs);
+    free(levels);
+    free(sums);
+    free(seen);
+    free(values);
+    free(weights);
 
     return 0;
 }
 
 int tabulate (dataset *ds, model *mod) {
 
-    int i, j, k;
+    int i, j, k, m, r;
+    int nthreads, nparts;
     char **varnames;
-    int found;
-    double freq_obs[2];
-    double target;
-    double *obs;
-    double weight;
+    tab_part *parts, *p;
+    int *cellmap;       /* row of the xtab for each row of a range's cells */
+    int *levelmap;      /* row of a frequency table for each row of a range's levels */
+    rowhash cells;      /* index of the xtab on its model variables */
+    rowhash *levels;    /* index of each frequency table on its value */
 
     printlog(VERBOSE, "Tabulating...\n");
 
     /* initialize data structures */
-    varnames = (char **) emalloc((2 + mod->numiv) * sizeof(char *));
+    varnames = (char **) arena_alloc(&mod->arena, (2 + mod->numiv) * sizeof(char *));
     for (i = 0; i < mod->numiv; i++) {
         varnames[i] = mod->ivnames[i];
     }
     varnames[i++] = mod->dvname;
-    varnames[i] = estrdup("_Count");
+    varnames[i] = arena_strdup(&mod->arena, "_Count");
     mod->xtab = add_dataset("_mlelr_xtab", 2 + mod->numiv, varnames, 0);
 
     /* array of datasets to store univariate frequencies */
-    mod->freqs = (dataset **) emalloc((2 + mod->numiv) * sizeof(dataset *));
+    mod->freqs = (dataset **) arena_alloc(&mod->arena, (2 + mod->numiv) * sizeof(dataset *));
     for (i = 0; i < mod->numiv; i++) {
         mod->freqs[i] = add_dataset("_mlelr_freq_iv", 2, freqvars, 0);
     }
     mod->freqs[i] = add_dataset("_mlelr_freq_dv", 2, freqvars, 0);
 
-    obs = (double *) emalloc((2 + mod->numiv) * sizeof(double));
-
-    /* loop for each observation in the dataset */
-    for (i = 0; i < ds->n; i++) {
+    advise_dataset(ds, 1);
 
-        /* get the weight for the current observation */
-        weight = (ds->weight == -1) ? 1.0 : ds->obs[i][ds->weight];
+    /* each partial row finds its cell and level by hashing rather than by a search of every row */
+    init_rowhash(&cells, 1 + mod->numiv);
+    levels = (rowhash *) emalloc((1 + mod->numiv) * sizeof(rowhash));
+    for (j = 0; j <= mod->numiv; j++) {
+        init_rowhash(&levels[j], 1);
+    }
 
-        /* the weight must be positive otherwise we will ignore the entire observation */
-        if (weight > 0) {
+    /* coded variables are counted by their codes, leaving only the crosstab to search for */
+    for (j = 0; j <= mod->numiv; j++) {
+        if (is_coded(ds, (j < mod->numiv) ? mod->iv[j] : mod->dv)) {
+            count_levels(ds, (j < mod->numiv) ? mod->iv[j] : mod->dv, mod->freqs[j], 1);
+        }
+    }
 
-            /* loop for each variable in the crosstab */
+    /***
+        The observations are looked up in ranges of TAB_PART_ROWS, up to
+        one range per thread at a time.  The cells and levels of each
+        range are then added to the model's tables in order of range, and
+        the weights added up in order of observation, on this thread, so
+        that the tables and every sum in them are the same as a single
+        pass over the observations would give, however many threads
+        there are.
+    ***/
+    nthreads = atoi(get_option("threads"));
+    nparts = (nthreads > 1) ? nthreads : 1;
+    parts = (tab_part *) emalloc(nparts * sizeof(tab_part));
+    cellmap = (int *) emalloc(TAB_PART_ROWS * sizeof(int));
+    levelmap = (int *) emalloc(TAB_PART_ROWS * sizeof(int));
+
+    for (i = 0; i < ds->n; ) {
+
+        for (k = 0; k < nparts && i < ds->n; k++) {
+            parts[k].ds = ds;
+            parts[k].mod = mod;
+            parts[k].first = i;
+            parts[k].count = (ds->n - i < TAB_PART_ROWS) ? ds->n - i : TAB_PART_ROWS;
+            parts[k].xtab = add_dataset("_mlelr_xtab_part", 2 + mod->numiv, varnames, 0);
+            parts[k].freqs = (dataset **) emalloc((1 + mod->numiv) * sizeof(dataset *));
+            parts[k].levels = (int **) emalloc((1 + mod->numiv) * sizeof(int *));
             for (j = 0; j <= mod->numiv; j++) {
+                parts[k].freqs[j] = add_dataset("_mlelr_freq_part", 2, freqvars, 0);
+                parts[k].levels[j] = (int *) emalloc(parts[k].count * sizeof(int));
+            }
+            parts[k].cells = (int *) emalloc(parts[k].count * sizeof(int));
+            parts[k].weights = (double *) emalloc(parts[k].count * sizeof(double));
+            i += parts[k].count;
+        }
 
-                /* get the target value from the current observation */
-                if (j < mod->numiv)
-                    target = ds->obs[i][mod->iv[j]];
-                else
-                    target = ds->obs[i][mod->dv];
-
-                /* search for the target in the existing frequency table */
-                for (k = 0, found = 0; k < mod->freqs[j]->n; k++) {
-                    if (target == mod->freqs[j]->obs[k][0]) {
-                        found = 1;
-                        break;
-                    }
-                }
+        run_parallel(parts, sizeof(tab_part), k, tabulate_part);
 
-                /* if not found, add to the frequency table */
-                if (!found) {
-                    freq_obs[0] = target;
-                    freq_obs[1] = weight;
-                    add_observation(mod->freqs[j], freq_obs);
-                }
-                /* otherwise, increment the frequency table */
-                else {
-                    mod->freqs[j]->obs[k][1] += weight;
+        /* add each range's cells and levels to the model's tables, and then its weights */
+        for (m = 0; m < k; m++) {
+            p = &parts[m];
+            map_rows(mod->xtab, &cells, p->xtab, cellmap);
+            for (r = 0; r < p->count; r++) {
+                if (p->cells[r] >= 0) {
+                    mod->xtab->obs[cellmap[p->cells[r]]][1 + mod->numiv] += p->weights[r];
                 }
-
-                obs[j] = target;
-
-            }   /* end loop for each variable in the crosstab */
-
-            /* search for the obs in the xtab */
-            found = find_observation(mod->xtab, obs, 1 + mod->numiv);
-            if (found == -1) {
-                obs[1 + mod->numiv] = weight;
-                add_observation(mod->xtab, obs);
             }
-            else {
-                mod->xtab->obs[found][1 + mod->numiv] += weight;
+            for (j = 0; j <= mod->numiv; j++) {
+                if (!is_coded(ds, (j < mod->numiv) ? mod->iv[j] : mod->dv)) {
+                    map_rows(mod->freqs[j], &levels[j], p->freqs[j], levelmap);
+                    for (r = 0; r < p->count; r++) {
+                        if (p->cells[r] >= 0) {
+                            mod->freqs[j]->obs[levelmap[p->levels[j][r]]][1] += p->weights[r];
+                        }
+                    }
+                }
+                free_dataset(p->freqs[j]);
+                free(p->levels[j]);
             }
+            free_dataset(p->xtab);
+            free(p->freqs);
+            free(p->levels);
+            free(p->cells);
+            free(p->weights);
+        }
 
-        } /* end test for positive weight */
+    }
 
-    }   /* end loop for each observation in the dataset */
+    free(cellmap);
+    free(levelmap);
+    free(parts);
+    free_rowhash(&cells);
+    for (j = 0; j <= mod->numiv; j++) {
+        free_rowhash(&levels[j]);
+    }
+    free(levels);
+    advise_dataset(ds, 0);
 
     /* sort the freq and xtab datasets */
     for (i = 0; i < 1 + mod->numiv; i++) {
@@ -178,3 +328,227 @@ int tabulate (dataset *ds, model *mod) {
     return 0;
 
 }
+
+
+/* static function definitions */
+
+static void *tabulate_part (void *arg) {
+
+    /***
+        Look up the cell and levels of each observation of one range in
+        the partial tables of its tab_part, adding those not yet there
+        with no weight, and record them with the weight.  Only the
+        tab_part is written, so ranges may be looked up at the same time.
+    ***/
+
+    tab_part *p = (tab_part *) arg;
+    dataset *ds = p->ds;
+    model *mod = p->mod;
+    int i, j, k, count;
+    int found;
+    double freq_obs[2];
+    double target;
+    double *obs;
+    double **values;
+    rowhash cells;
+    rowhash *levels;
+
+    obs = (double *) emalloc((2 + mod->numiv) * sizeof(double));
+    values = (double **) emalloc((1 + mod->numiv) * sizeof(double *));
+    for (j = 0; j <= mod->numiv; j++) {
+        values[j] = (double *) emalloc(BATCH_ROWS * sizeof(double));
+    }
+
+    init_rowhash(&cells, 1 + mod->numiv);
+    levels = (rowhash *) emalloc((1 + mod->numiv) * sizeof(rowhash));
+    for (j = 0; j <= mod->numiv; j++) {
+        init_rowhash(&levels[j], 1);
+    }
+
+    /* the weights are read whole, since they are kept for the sums */
+    for (i = 0; i < p->count; i += BATCH_ROWS) {
+        count = (p->count - i < BATCH_ROWS) ? p->count - i : BATCH_ROWS;
+        read_batch(ds, ds->weight, p->first + i, count, &p->weights[i]);
+    }
+
+    freq_obs[1] = 0;
+    obs[1 + mod->numiv] = 0;
+
+    /* loop for each observation in the range */
+    for (i = 0; i < p->count; i++) {
+
+        /* read the next batch of each variable in the crosstab, a column at a time */
+        if (i % BATCH_ROWS == 0) {
+            count = (p->count - i < BATCH_ROWS) ? p->count - i : BATCH_ROWS;
+            for (j = 0; j <= mod->numiv; j++) {
+                read_batch(ds, (j < mod->numiv) ? mod->iv[j] : mod->dv, p->first + i, count, values[j]);
+            }
+        }
+
+        /* the weight must be positive otherwise we will ignore the entire observation */
+        if (!(p->weights[i] > 0)) {
+            p->cells[i] = -1;
+            continue;
+        }
+
+        /* loop for each variable in the crosstab */
+        for (j = 0; j <= mod->numiv; j++) {
+
+            /* get the target value from the current observation */
+            target = values[j][i % BATCH_ROWS];
+            obs[j] = target;
+
+            if (is_coded(ds, (j < mod->numiv) ? mod->iv[j] : mod->dv))
+                continue;
+
+            /* search for the target in the range's levels, adding it if not found */
+            k = rowhash_find(&levels[j], p->freqs[j], &target);
+            if (k == -1) {
+                freq_obs[0] = target;
+                add_observation(p->freqs[j], freq_obs);
+                k = p->freqs[j]->n - 1;
+                rowhash_add(&levels[j], p->freqs[j], k);
+            }
+            p->levels[j][i] = k;
+
+        }   /* end loop for each variable in the crosstab */
+
+        /* search for the obs in the range's cells, adding it if not found */
+        found = rowhash_find(&cells, p->xtab, obs);
+        if (found == -1) {
+            add_observation(p->xtab, obs);
+            found = p->xtab->n - 1;
+            rowhash_add(&cells, p->xtab, found);
+        }
+        p->cells[i] = found;
+
+    }   /* end loop for each observation in the range */
+
+    for (j = 0; j <= mod->numiv; j++) {
+        free(values[j]);
+        free_rowhash(&levels[j]);
+    }
+    free(values);
+    free(levels);
+    free(obs);
+    free_rowhash(&cells);
+
+    return NULL;
+}
+
+static void map_rows (dataset *into, rowhash *index, dataset *from, int *map) {
+
+    /***
+        Set map[i] to the row of the table into, found through index,
+        that has the key of row i of the partial table from, appending a
+        copy of that row, with its weight of zero, where there is none.
+    ***/
+
+    int i;
+
+    for (i = 0; i < from->n; i++) {
+        map[i] = rowhash_find(index, into, from->obs[i]);
+        if (map[i] == -1) {
+            add_observation(into, from->obs[i]);
+            map[i] = into->n - 1;
+            rowhash_add(index, into, map[i]);
+        }
+    }
+}
+
+static void count_levels (dataset *ds, int var, dataset *freq, int positive) {
+
+    /***
+        Add a row to freq for each level of the coded variable var that
+        occurs, with the sum of the weights of the observations at that
+        level, in order of level.  If positive is set, observations
+        without a positive weight are left out.
+    ***/
+
+    double *sums;
+    char *seen;
+    double weight;
+    double *weights;
+    int i, code;
+
+    new_tally(ds, var, &sums, &seen);
+    weights = (double *) emalloc(BATCH_ROWS * sizeof(double));
+
+    for (i = 0; i < ds->n; i++) {
+        if (i % BATCH_ROWS == 0) {
+            read_batch(ds, ds->weight, i, (ds->n - i < BATCH_ROWS) ? ds->n - i : BATCH_ROWS, weights);
+        }
+        weight = weights[i % BATCH_ROWS];
+        if (positive && !(weight > 0)) {
+            continue;
+        }
+        code = get_code(ds, i, var);
+        sums[code] = (seen[code]) ? sums[code] + weight : weight;
+        seen[code] = 1;
+    }
+
+    add_tally(ds, var, freq, sums, seen);
+    free(weights);
+}
+
+static void new_tally (dataset *ds, int var, double **sums, char **seen) {
+
+    /***
+        Allocate and clear a sum of weights and a flag for each level of
+        the coded variable var.
+    ***/
+
+    int nlevels = ds->cols[var].nlevels;
+    int code;
+
+    *sums = (double *) emalloc((nlevels > 0 ? nlevels : 1) * sizeof(double));
+    *seen = (char *) emalloc(nlevels > 0 ? nlevels : 1);
+    for (code = 0; code < nlevels; code++) {
+        (*sums)[code] = 0;
+        (*seen)[code] = 0;
+    }
+}
+
+static void add_tally (dataset *ds, int var, dataset *freq, double *sums, char *seen) {
+
+    /***
+        Add a row to freq for each level of var that was seen, in order of
+        level, and free the tally.
+    ***/
+
+    double obs[2];
+    int code;
+
+    for (code = 0; code < ds->cols[var].nlevels; code++) {
+        if (seen[code]) {
+            obs[0] = ds->cols[var].levels[code];
+            obs[1] = sums[code];
+            add_observation(freq, obs);
+        }
+    }
+
+    free(sums);
+    free(seen);
+}
+
+
+static void read_batch (dataset *ds, int var, int first, int count, double *buf) {
+
+    /***
+        Fill buf with count observations of var from first on.  A var of
+        -1 stands for the weight of a dataset with none, which is 1 for
+        every observation.
+    ***/
+
+    int i;
+
+    if (var == -1) {
+        for (i = 0; i < count; i++) {
+            buf[i] = 1.0;
+        }
+    }
+    else {
+        get_values(ds, var, first, count, buf);
+    }
+
+}
@@ -26,6 +26,6 @@ Copyright (C) 2015 Scott A. Czepiel
 
 /* forward declarations for publically available functions defined in tabulate.c */
 extern int tabulate (dataset *ds, model *mod);
-extern int frequency_table (dataset *ds, int var);
+extern int frequency_table (dataset *ds, int *vars, int nvars);
 
 #endif